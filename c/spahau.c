@@ -25,6 +25,10 @@
  */
 
 #include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include <err.h>
 #include <inttypes.h>
@@ -36,9 +40,17 @@
 #include <unistd.h>
 
 #include "spahau.h"
+#include "sphdomain.h"
+#include "sphfilter.h"
 #include "sphhost.h"
+#include "sphjournal.h"
+#include "sphlog.h"
 #include "sphresponse.h"
 #include "sphquery.h"
+#include "sphsweep.h"
+#include "sphtrace.h"
+#include "sphutil.h"
+#include "sphwatch.h"
 
 #define VERSION_STRING	"0.1.0.dev2"
 
@@ -46,6 +58,13 @@
 
 static bool		verbose;
 
+struct range_source {
+	const struct sph_range *ranges;
+	size_t count;
+	size_t idx;
+	uint32_t next;
+};
+
 struct selftest_item {
 	const char * const address;
 	const uint32_t result[RESPONSE_SIZE];
@@ -65,26 +84,76 @@ static struct selftest_item selftest_data[] = {
 #define SELFTEST_COUNT	(sizeof(selftest_data) / sizeof(selftest_data[0]))
 
 const char *rbl_domain = RBL_DOMAIN;
+const struct sph_filter *prefilter;
+const struct sockaddr_in *dns_server;
+struct sph_trace *dns_trace;
 
 static void
 usage(const bool _ferr)
 {
 	const char * const s =
-	    "Usage:\tspahau [-DHNv] [-d rbl.domain] address...\n"
+	    "Usage:\tspahau [-DHNv] [-d rbl.domain] [-f prefilter] address...\n"
+	    "\tspahau [-v] [-d rbl.domain] [-f prefilter] [-J journal] "
+	    "[-p parallel]\n"
+	    "\t\taddress/prefix...\n"
+	    "\tspahau [-v] [-d rbl.domain] [-f prefilter] [-i interval] "
+	    "[-m interval]\n"
+	    "\t\t[-p parallel] --watch address[/prefix]...\n"
+	    "\tspahau [-v] [-d rbl.domain] [-f prefilter] [-p parallel] "
+	    "-L logfile...\n"
+	    "\tspahau [-Hv] [-d rbl.domain] [-p parallel] -n domain|url|-...\n"
+	    "\tspahau [-v] [-e rate] -B -f prefilter zonefile...\n"
+	    "\tspahau [-Fv] [-s address[:port]] -R tracefile\n"
 	    "\tspahau [-v] [-d rbl.domain] -T address...\n"
 	    "\tspahau -V | -h | --version | --help\n"
 	    "\tspahau --features\n"
 	    "\n"
+	    "\tAll the query modes also accept [-s address[:port]] "
+	    "[-w tracefile].\n"
+	    "\n"
+	    "\t-B\tbuild a prefilter out of rbldnsd-style zone files\n"
 	    "\t-D\tdescribe the specified RBL return codes/addresses\n"
 	    "\t-d\tspecify the RBL domain to test against (default: "
-	    RBL_DOMAIN ")\n"
+	    RBL_DOMAIN ",\n"
+	    "\t\tor " DBL_DOMAIN " for domain names)\n"
+	    "\t-e\tspecify the prefilter's false positive rate "
+	    "(default: %.2f)\n"
+	    "\t-F\tin replay mode, answer immediately instead of "
+	    "preserving the latencies\n"
+	    "\t-f\tskip the queries for addresses not found in "
+	    "the prefilter\n"
 	    "\t-H\tonly output the RBL hostnames, do not send queries\n"
 	    "\t-h\tdisplay program usage information and exit\n"
+	    "\t-J\tkeep a journal of the checked address ranges, resume "
+	    "from it if present\n"
+	    "\t-L\tcheck the [a.b.c.d] client addresses found in "
+	    "mail server logs\n"
+	    "\t-i\tspecify the longest interval in seconds between "
+	    "re-checks in watch mode\n"
+	    "\t\t(default: %d)\n"
+	    "\t-m\tspecify the shortest interval in seconds between "
+	    "re-checks in watch mode\n"
+	    "\t\t(default: %d; only lower it for testing)\n"
+	    "\t-n\tcheck domain names, e-mail addresses, or URLs instead of "
+	    "IP addresses;\n"
+	    "\t\t\"-\" reads them from the standard input, one per line\n"
+	    "\t-p\tspecify the number of queries in flight when checking "
+	    "many addresses\n"
+	    "\t\t(default: %d)\n"
+	    "\t-R\tanswer DNS queries using a recorded trace, listening on "
+	    "the -s address\n"
+	    "\t\t(default: 127.0.0.1:%d)\n"
+	    "\t-s\tsend the DNS queries to this server, not to "
+	    "the system resolver\n"
 	    "\t-T\trun a self test: try to obtain some expected responses\n"
 	    "\t-V\tdisplay program version information and exit\n"
-	    "\t-v\tverbose operation; display diagnostic output\n";
+	    "\t-v\tverbose operation; display diagnostic output\n"
+	    "\t-w\trecord the DNS queries and answers into a trace file\n"
+	    "\t--watch\tkeep re-checking the addresses, report any changes\n";
 
-	fprintf(_ferr? stderr: stdout, "%s", s);
+	fprintf(_ferr? stderr: stdout, s, FILTER_FP_RATE_DEFAULT,
+	    WATCH_INTERVAL_DEFAULT, WATCH_INTERVAL_MIN, SWEEP_PARALLEL_DEFAULT,
+	    REPLAY_PORT_DEFAULT);
 	if (_ferr)
 		exit(1);
 }
@@ -98,7 +167,7 @@ version(void)
 static void
 features(void)
 {
-	puts("Features: spahau=" VERSION_STRING);
+	puts("Features: spahau=" VERSION_STRING " domain=1.0 journal=1.0 logscan=1.0 prefilter=1.0 range=1.0 trace=1.0 watch=1.0");
 }
 
 void
@@ -237,21 +306,163 @@ show_response(const char * const address)
 	free(resp);
 }
 
+static bool
+next_in_range(void * const data, uint32_t * const address)
+{
+	struct range_source * const src = data;
+
+	if (src->idx == src->count)
+		return false;
+	*address = src->next;
+	if (src->next == src->ranges[src->idx].last) {
+		src->idx++;
+		if (src->idx < src->count)
+			src->next = src->ranges[src->idx].first;
+	} else {
+		src->next++;
+	}
+	return true;
+}
+
+static bool
+has_ranges(const int argc, char * const argv[])
+{
+	for (size_t i = 0; i < (size_t)argc; i++)
+		if (strchr(argv[i], '/') != NULL)
+			return true;
+	return false;
+}
+
+static struct sph_range *
+parse_ranges(const int argc, char * const argv[])
+{
+	struct sph_range * const ranges = malloc(argc * sizeof(*ranges));
+	if (ranges == NULL)
+		err(1, "Could not allocate memory for %d ranges", argc);
+	for (size_t i = 0; i < (size_t)argc; i++)
+		if (!sph_parse_range(argv[i], &ranges[i]))
+			exit(1);
+	return ranges;
+}
+
+/* Identify the run, so that a journal is only resumed by the same one. */
+static uint64_t
+ranges_hash(const struct sph_range * const ranges, const size_t count,
+		uint64_t * const total)
+{
+	uint64_t hash = sph_hash(SPH_HASH_INIT, rbl_domain,
+	    strlen(rbl_domain) + 1);
+	*total = 0;
+	for (size_t i = 0; i < count; i++) {
+		unsigned char bounds[8];
+		sph_put32(bounds, ranges[i].first);
+		sph_put32(bounds + 4, ranges[i].last);
+		hash = sph_hash(hash, bounds, sizeof(bounds));
+		*total += (uint64_t)(ranges[i].last - ranges[i].first) + 1;
+	}
+	return hash;
+}
+
+static int
+check_ranges(const int argc, char * const argv[], const unsigned parallel,
+		const char * const journal_path)
+{
+	struct sph_range * const ranges = parse_ranges(argc, argv);
+
+	struct range_source src = {
+		.ranges = ranges,
+		.count = argc,
+		.idx = 0,
+		.next = ranges[0].first,
+	};
+	const struct sweep_source source = {
+		.next = next_in_range,
+		.data = &src,
+	};
+	struct sweep_result result = { 0 };
+	bool completed;
+	if (journal_path != NULL) {
+		uint64_t total;
+		const uint64_t hash = ranges_hash(ranges, argc, &total);
+		struct sph_journal * const journal =
+		    journal_open(journal_path, hash, total, &result);
+		if (journal == NULL) {
+			free(ranges);
+			sweep_free(&result);
+			return (1);
+		}
+		const struct sweep_source journaled =
+		    journal_source(journal, &source);
+		completed = sweep(&journaled, parallel, &result);
+		if (!journal_close(journal))
+			completed = false;
+	} else {
+		completed = sweep(&source, parallel, &result);
+	}
+	free(ranges);
+	sweep_report(&result);
+	sweep_free(&result);
+	return (completed ? 0 : 1);
+}
+
+/* Make sure the whole trace was written out. */
+static int
+finish(const int res)
+{
+	if (dns_trace != NULL && !trace_close(dns_trace))
+		return (1);
+	return (res);
+}
+
 int
 main(int argc, char * const argv[])
 {
 	bool hflag = false, Vflag = false, show_features = false;
+	bool watchflag = false, build_filter = false, scan_logs = false;
+	bool check_domains = false, domain_specified = false;
+	bool replay_trace = false, full_speed = false;
+	const char *server = NULL, *trace_path = NULL;
+	const char *filter_path = NULL, *journal_path = NULL;
+	double fp_rate = FILTER_FP_RATE_DEFAULT;
 	int ch;
 	void (*testfunc)(const char *) = test;
+	unsigned parallel = SWEEP_PARALLEL_DEFAULT;
+	uint32_t min_interval = WATCH_INTERVAL_MIN;
+	uint32_t max_interval = WATCH_INTERVAL_DEFAULT;
 
-	while (ch = getopt(argc, argv, "Dd:HhTVv-:"), ch != -1)
+	while (ch = getopt(argc, argv, "BDd:e:Ff:Hhi:J:Lm:np:Rs:TVvw:-:"), ch != -1)
 		switch (ch) {
+			case 'B':
+				build_filter = true;
+				break;
+
 			case 'D':
 				testfunc = show_response;
 				break;
 
 			case 'd':
 				rbl_domain = optarg;
+				domain_specified = true;
+				break;
+
+			case 'e': {
+				char *end;
+				fp_rate = strtod(optarg, &end);
+				if (*optarg == '\0' || *end != '\0' ||
+				    !(fp_rate > 0 && fp_rate < 1)) {
+					warnx("The false positive rate must be "
+					    "between 0 and 1");
+					usage(true);
+				}
+				break;
+			}
+
+			case 'F':
+				full_speed = true;
+				break;
+
+			case 'f':
+				filter_path = optarg;
 				break;
 
 			case 'H':
@@ -262,6 +473,72 @@ main(int argc, char * const argv[])
 				hflag = true;
 				break;
 
+			case 'i': {
+				char *end;
+				const unsigned long value =
+				    strtoul(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' ||
+				    value < WATCH_INTERVAL_MIN ||
+				    value > UINT32_MAX) {
+					warnx("The watch interval must be at "
+					    "least %d seconds",
+					    WATCH_INTERVAL_MIN);
+					usage(true);
+				}
+				max_interval = value;
+				break;
+			}
+
+			case 'J':
+				journal_path = optarg;
+				break;
+
+			case 'L':
+				scan_logs = true;
+				break;
+
+			case 'm': {
+				char *end;
+				const unsigned long value =
+				    strtoul(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' ||
+				    value < 1 || value > WATCH_INTERVAL_MIN) {
+					warnx("The shortest watch interval must "
+					    "be between 1 and %d seconds",
+					    WATCH_INTERVAL_MIN);
+					usage(true);
+				}
+				min_interval = value;
+				break;
+			}
+
+			case 'n':
+				check_domains = true;
+				break;
+
+			case 'p': {
+				char *end;
+				const unsigned long value =
+				    strtoul(optarg, &end, 10);
+				if (*optarg == '\0' || *end != '\0' ||
+				    value < 1 || value > SWEEP_PARALLEL_MAX) {
+					warnx("The number of parallel queries "
+					    "must be between 1 and %d",
+					    SWEEP_PARALLEL_MAX);
+					usage(true);
+				}
+				parallel = value;
+				break;
+			}
+
+			case 'R':
+				replay_trace = true;
+				break;
+
+			case 's':
+				server = optarg;
+				break;
+
 			case 'T':
 				testfunc = selftest;
 				break;
@@ -274,6 +551,10 @@ main(int argc, char * const argv[])
 				verbose = true;
 				break;
 
+			case 'w':
+				trace_path = optarg;
+				break;
+
 			case '-':
 				if (strcmp(optarg, "help") == 0)
 					hflag = true;
@@ -281,6 +562,8 @@ main(int argc, char * const argv[])
 					Vflag = true;
 				else if (strcmp(optarg, "features") == 0)
 					show_features = true;
+				else if (strcmp(optarg, "watch") == 0)
+					watchflag = true;
 				else {
 					warnx("Invalid long option '%s' specified", optarg);
 					usage(true);
@@ -306,7 +589,92 @@ main(int argc, char * const argv[])
 	if (argc == 0)
 		usage(true);
 
+	struct sockaddr_in server_addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(replay_trace ?
+		    REPLAY_PORT_DEFAULT : QUERY_PORT_DEFAULT),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	if (server != NULL) {
+		uint32_t address;
+		uint16_t port = ntohs(server_addr.sin_port);
+		if (!sph_parse_server(server, &address, &port))
+			return (1);
+		server_addr.sin_addr.s_addr = htonl(address);
+		server_addr.sin_port = htons(port);
+	}
+
+	if (replay_trace) {
+		if (argc != 1)
+			errx(1, "A single trace file must be specified");
+		if (trace_path != NULL)
+			errx(1, "A replayed trace may not be recorded again");
+		return (replay(argv[0], &server_addr, full_speed));
+	}
+	if (server != NULL)
+		dns_server = &server_addr;
+
+	if (build_filter) {
+		if (filter_path == NULL)
+			errx(1, "No prefilter file (-f) specified");
+		return (filter_build(filter_path, fp_rate, argc, argv) ? 0 : 1);
+	}
+	struct sph_filter filter;
+	if (filter_path != NULL) {
+		if (!filter_open(filter_path, &filter))
+			return (1);
+		prefilter = &filter;
+	}
+
+	if (journal_path != NULL && (watchflag || scan_logs ||
+	    check_domains || !has_ranges(argc, argv)))
+		errx(1, "A journal may only be kept when checking "
+		    "address ranges");
+
+	if (trace_path != NULL) {
+		dns_trace = trace_create(trace_path);
+		if (dns_trace == NULL)
+			return (1);
+	}
+
+	if (check_domains) {
+		if (testfunc != test && testfunc != show_hostname)
+			errx(1, "Domain names may only be checked or "
+			    "converted to RBL hostnames");
+		if (watchflag || scan_logs || filter_path != NULL)
+			errx(1, "Domain names may not be watched, "
+			    "prefiltered, or found in log files");
+		if (!domain_specified)
+			rbl_domain = DBL_DOMAIN;
+		return (finish(domain_check(argc, argv, parallel,
+		    testfunc == show_hostname)));
+	}
+
+	if (scan_logs) {
+		if (testfunc != test || watchflag)
+			errx(1, "The addresses found in log files may only "
+			    "be checked once");
+		return (finish(logscan(argc, argv, parallel)));
+	}
+
+	if (watchflag) {
+		if (testfunc != test)
+			errx(1, "Only plain queries may be repeated "
+			    "in watch mode");
+		watch(parse_ranges(argc, argv), argc, min_interval,
+		    max_interval, parallel);
+		/* NOTREACHED */
+	}
+
+	if (has_ranges(argc, argv)) {
+		if (testfunc != test)
+			errx(1, "Address ranges may only be checked, "
+			    "not described, converted, or self-tested");
+		return (finish(check_ranges(argc, argv, parallel,
+		    journal_path)));
+	}
+
 	for (size_t i = 0; i < (size_t)argc; i++)
 		testfunc(argv[i]);
-	return (0);
+	return (finish(0));
 }
@@ -35,7 +35,14 @@
 #endif
 #endif
 
+struct sockaddr_in;
+struct sph_filter;
+struct sph_trace;
+
 extern const char *rbl_domain;
+extern const struct sph_filter *prefilter;
+extern const struct sockaddr_in *dns_server;
+extern struct sph_trace *dns_trace;
 
 void debug(const char *msg, ...) __printflike(1, 2);
 
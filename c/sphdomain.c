@@ -0,0 +1,775 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "spahau.h"
+#include "sphdomain.h"
+#include "sphquery.h"
+#include "sphsweep.h"
+#include "sphutil.h"
+
+#define TABLE_BITS_INITIAL	10
+#define ARENA_SIZE_INITIAL	65536
+
+#define NAME_NONE	UINT32_MAX
+
+/* Do not even try to make sense of anything longer than that. */
+#define HOST_INPUT_MAX	1024
+
+#define LABEL_MAX	63
+#define ACE_PREFIX	"xn--"
+
+/* RFC 3492, section 5: the Punycode parameters. */
+#define PUNY_BASE	36
+#define PUNY_TMIN	1
+#define PUNY_TMAX	26
+#define PUNY_SKEW	38
+#define PUNY_DAMP	700
+#define PUNY_BIAS	72
+#define PUNY_N		0x80
+
+struct name {
+	size_t offset;
+	size_t len;
+	uint64_t hash;
+	uint32_t value;
+};
+
+/*
+ * An interned string table: the strings themselves are kept in a single
+ * arena, the ids are indices into the names array.
+ */
+struct name_table {
+	char *arena;
+	size_t arena_used;
+	size_t arena_size;
+	struct name *names;
+	size_t count;
+	size_t alloc;
+	uint32_t *slots;
+	unsigned bits;
+};
+
+struct domain_set {
+	/* The host part of the input strings, mapped to a normalised id. */
+	struct name_table hosts;
+	/* The normalised names, mapped to the number of times seen. */
+	struct name_table names;
+	size_t total;
+	size_t next;
+};
+
+/*
+ * Second-level labels that are commonly used as public suffixes under
+ * two-letter country code top-level domains, e.g. "co.uk" or "com.au".
+ */
+static const char * const cc_second_level[] = {
+	"ac", "co", "com", "edu", "go", "gov", "ltd", "mil", "ne", "net",
+	"nom", "or", "org", "plc", "sch",
+};
+
+#define CC_SECOND_LEVEL_COUNT \
+	(sizeof(cc_second_level) / sizeof(cc_second_level[0]))
+
+static bool
+table_init(struct name_table * const table)
+{
+	*table = (struct name_table){
+		.arena = malloc(ARENA_SIZE_INITIAL),
+		.arena_size = ARENA_SIZE_INITIAL,
+		.slots = calloc((size_t)1 << TABLE_BITS_INITIAL,
+		    sizeof(*table->slots)),
+		.bits = TABLE_BITS_INITIAL,
+	};
+	if (table->arena == NULL || table->slots == NULL) {
+		warn("Could not allocate memory for the domain names");
+		free(table->arena);
+		free(table->slots);
+		return false;
+	}
+	return true;
+}
+
+static void
+table_free(struct name_table * const table)
+{
+	free(table->arena);
+	free(table->names);
+	free(table->slots);
+}
+
+static const char *
+table_string(const struct name_table * const table, const uint32_t id)
+{
+	return table->arena + table->names[id].offset;
+}
+
+static size_t
+slot_for(const struct name_table * const table, const uint64_t hash)
+{
+	return SPH_HASH_SLOT(hash, table->bits);
+}
+
+/* Return the slot where the string is, or where it should be added. */
+static size_t
+table_find(const struct name_table * const table, const char * const str,
+		const size_t len, const uint64_t hash)
+{
+	const size_t mask = ((size_t)1 << table->bits) - 1;
+	size_t idx = slot_for(table, hash);
+
+	for (; table->slots[idx] != 0; idx = (idx + 1) & mask) {
+		const struct name * const name =
+		    &table->names[table->slots[idx] - 1];
+		if (name->hash == hash && name->len == len &&
+		    memcmp(table->arena + name->offset, str, len) == 0)
+			break;
+	}
+	return idx;
+}
+
+static bool
+table_grow(struct name_table * const table)
+{
+	const unsigned bits = table->bits + 1;
+	uint32_t * const slots = calloc((size_t)1 << bits, sizeof(*slots));
+	if (slots == NULL) {
+		warn("Could not allocate memory for %zu domain names",
+		    table->count);
+		return false;
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->bits = bits;
+
+	const size_t mask = ((size_t)1 << bits) - 1;
+	for (size_t id = 0; id < table->count; id++) {
+		size_t idx = slot_for(table, table->names[id].hash);
+		while (slots[idx] != 0)
+			idx = (idx + 1) & mask;
+		slots[idx] = id + 1;
+	}
+	return true;
+}
+
+/* Intern a string, return its id or NAME_NONE if out of memory. */
+static uint32_t
+table_add(struct name_table * const table, const char * const str,
+		const size_t len, const uint64_t hash, const size_t slot,
+		const uint32_t value)
+{
+	if (table->count == NAME_NONE - 1) {
+		warnx("Too many different domain names");
+		return NAME_NONE;
+	}
+	if (table->count == table->alloc) {
+		const size_t alloc = table->alloc == 0 ? 256 : table->alloc * 2;
+		struct name * const names =
+		    realloc(table->names, alloc * sizeof(*names));
+		if (names == NULL) {
+			warn("Could not allocate memory for %zu domain names",
+			    alloc);
+			return NAME_NONE;
+		}
+		table->names = names;
+		table->alloc = alloc;
+	}
+	if (table->arena_size - table->arena_used < len + 1) {
+		size_t size = table->arena_size * 2;
+		while (size - table->arena_used < len + 1)
+			size *= 2;
+		char * const arena = realloc(table->arena, size);
+		if (arena == NULL) {
+			warn("Could not allocate memory for the domain names");
+			return NAME_NONE;
+		}
+		table->arena = arena;
+		table->arena_size = size;
+	}
+
+	const uint32_t id = table->count++;
+	table->names[id] = (struct name){
+		.offset = table->arena_used,
+		.len = len,
+		.hash = hash,
+		.value = value,
+	};
+	memcpy(table->arena + table->arena_used, str, len);
+	table->arena[table->arena_used + len] = '\0';
+	table->arena_used += len + 1;
+	table->slots[slot] = id + 1;
+
+	if (SPH_TABLE_OVERFULL(table->count, table->bits) && !table_grow(table))
+		return NAME_NONE;
+	return id;
+}
+
+static bool
+is_space(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool
+is_scheme_char(const char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	    (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.';
+}
+
+static bool
+all_digits(const char * const str, const size_t len)
+{
+	for (size_t idx = 0; idx < len; idx++)
+		if (str[idx] < '0' || str[idx] > '9')
+			return false;
+	return len > 0;
+}
+
+/*
+ * Find the host part of a domain name, an e-mail address, or a URL:
+ * strip the scheme, the user information, the port, the path,
+ * the query, and the fragment.
+ */
+static const char *
+extract_host(const char * const raw, const size_t len,
+		const char ** const host, size_t * const hostlen)
+{
+	const char *start = raw, *end = raw + len;
+	while (start < end && is_space(*start))
+		start++;
+	while (end > start && is_space(end[-1]))
+		end--;
+
+	const char *scheme = start;
+	while (scheme < end && is_scheme_char(*scheme))
+		scheme++;
+	if (scheme > start && end - scheme >= 3 &&
+	    memcmp(scheme, "://", 3) == 0)
+		start = scheme + 3;
+	else if (end - start >= 7 && strncasecmp(start, "mailto:", 7) == 0)
+		start += 7;
+
+	const char *p = start;
+	while (p < end && *p != '/' && *p != '?' && *p != '#')
+		p++;
+	end = p;
+	for (p = end; p > start; p--)
+		if (p[-1] == '@') {
+			start = p;
+			break;
+		}
+
+	if (start < end && *start == '[')
+		return "an IP address literal";
+	for (p = end; p > start; p--)
+		if (p[-1] == ':') {
+			if (!all_digits(p, end - p))
+				return "an invalid port number";
+			end = p - 1;
+			break;
+		}
+
+	if (start == end)
+		return "no host name";
+	if (end - start > HOST_INPUT_MAX)
+		return "too long";
+	*host = start;
+	*hostlen = end - start;
+	return NULL;
+}
+
+/* Decode a UTF-8 string, rejecting overlong forms and surrogates. */
+static const char *
+decode_utf8(const char * const str, const size_t len, uint32_t * const cps,
+		size_t * const count)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char * const end = p + len;
+	size_t n = 0;
+
+	while (p < end) {
+		const unsigned char c = *p++;
+		uint32_t cp, min;
+		size_t more;
+		if (c < 0x80) {
+			cps[n++] = c;
+			continue;
+		} else if ((c & 0xE0) == 0xC0) {
+			cp = c & 0x1F;
+			more = 1;
+			min = 0x80;
+		} else if ((c & 0xF0) == 0xE0) {
+			cp = c & 0x0F;
+			more = 2;
+			min = 0x800;
+		} else if ((c & 0xF8) == 0xF0) {
+			cp = c & 0x07;
+			more = 3;
+			min = 0x10000;
+		} else {
+			return "not valid UTF-8";
+		}
+		if ((size_t)(end - p) < more)
+			return "not valid UTF-8";
+		for (; more > 0; more--, p++) {
+			if ((*p & 0xC0) != 0x80)
+				return "not valid UTF-8";
+			cp = (cp << 6) | (*p & 0x3F);
+		}
+		if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+			return "not valid UTF-8";
+		cps[n++] = cp;
+	}
+	*count = n;
+	return NULL;
+}
+
+static bool
+is_dot(const uint32_t cp)
+{
+	/* The full stop and the ideographic, fullwidth, and halfwidth ones. */
+	return cp == '.' || cp == 0x3002 || cp == 0xFF0E || cp == 0xFF61;
+}
+
+static char
+puny_digit(const uint32_t digit)
+{
+	return digit < 26 ? 'a' + digit : '0' + (digit - 26);
+}
+
+static uint32_t
+puny_adapt(uint32_t delta, const uint32_t points, const bool first)
+{
+	delta = first ? delta / PUNY_DAMP : delta / 2;
+	delta += delta / points;
+
+	uint32_t k = 0;
+	while (delta > ((PUNY_BASE - PUNY_TMIN) * PUNY_TMAX) / 2) {
+		delta /= PUNY_BASE - PUNY_TMIN;
+		k += PUNY_BASE;
+	}
+	return k + (PUNY_BASE - PUNY_TMIN + 1) * delta / (delta + PUNY_SKEW);
+}
+
+/* Encode a label as Punycode (RFC 3492), sans the ACE prefix. */
+static const char *
+punycode_encode(const uint32_t * const cps, const size_t count,
+		char * const out, size_t * const outlen, const size_t max)
+{
+	size_t len = 0;
+	for (size_t idx = 0; idx < count; idx++)
+		if (cps[idx] < 0x80) {
+			if (len == max)
+				return "a label that is too long";
+			out[len++] = cps[idx];
+		}
+	const size_t basic = len;
+	if (basic > 0) {
+		if (len == max)
+			return "a label that is too long";
+		out[len++] = '-';
+	}
+
+	uint32_t n = PUNY_N, delta = 0, bias = PUNY_BIAS;
+	for (size_t handled = basic; handled < count; delta++, n++) {
+		uint32_t m = UINT32_MAX;
+		for (size_t idx = 0; idx < count; idx++)
+			if (cps[idx] >= n && cps[idx] < m)
+				m = cps[idx];
+		if (m - n > (UINT32_MAX - delta) / (handled + 1))
+			return "a label that is too long";
+		delta += (m - n) * (handled + 1);
+		n = m;
+
+		for (size_t idx = 0; idx < count; idx++) {
+			if (cps[idx] < n && ++delta == 0)
+				return "a label that is too long";
+			if (cps[idx] != n)
+				continue;
+
+			uint32_t q = delta;
+			for (uint32_t k = PUNY_BASE;; k += PUNY_BASE) {
+				const uint32_t t =
+				    k <= bias ? PUNY_TMIN :
+				    k >= bias + PUNY_TMAX ? PUNY_TMAX :
+				    k - bias;
+				if (q < t)
+					break;
+				if (len == max)
+					return "a label that is too long";
+				out[len++] = puny_digit(
+				    t + (q - t) % (PUNY_BASE - t));
+				q = (q - t) / (PUNY_BASE - t);
+			}
+			if (len == max)
+				return "a label that is too long";
+			out[len++] = puny_digit(q);
+			bias = puny_adapt(delta, handled + 1, handled == basic);
+			delta = 0;
+			handled++;
+		}
+	}
+	*outlen = len;
+	return NULL;
+}
+
+static bool
+is_label_char(const uint32_t cp)
+{
+	return (cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9') ||
+	    cp == '-' || cp == '_';
+}
+
+/*
+ * Lowercase a code point using the Unicode simple case folding for
+ * the Latin-1, Latin Extended-A, Greek, and Cyrillic capital letters;
+ * the rest of the scripts are left alone.
+ */
+static uint32_t
+fold_case(const uint32_t cp)
+{
+	if (cp >= 'A' && cp <= 'Z')
+		return cp + ('a' - 'A');
+	if (cp < 0xC0)
+		return cp;
+	if (cp <= 0xDE)
+		return cp == 0xD7 ? cp : cp + 0x20;
+	/* U+0130 has no simple case folding. */
+	if ((cp >= 0x100 && cp <= 0x137 && cp != 0x130) ||
+	    (cp >= 0x14A && cp <= 0x177))
+		return cp | 1;
+	if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E))
+		return (cp & 1) != 0 ? cp + 1 : cp;
+	if (cp == 0x178)
+		return 0xFF;
+	if (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2)
+		return cp + 0x20;
+	if (cp >= 0x400 && cp <= 0x40F)
+		return cp + 0x50;
+	if (cp >= 0x410 && cp <= 0x42F)
+		return cp + 0x20;
+	return cp;
+}
+
+/* Append a single label, lowercased and IDNA-encoded if needed. */
+static const char *
+append_label(uint32_t * const cps, const size_t count, char * const out,
+		size_t * const outlen)
+{
+	if (count == 0)
+		return "an empty label";
+
+	bool ascii = true;
+	for (size_t idx = 0; idx < count; idx++) {
+		cps[idx] = fold_case(cps[idx]);
+		if (cps[idx] >= 0x80)
+			ascii = false;
+		if (cps[idx] < 0x80 && !is_label_char(cps[idx]))
+			return "an invalid character";
+	}
+
+	char label[LABEL_MAX];
+	size_t len;
+	if (ascii) {
+		if (count > LABEL_MAX)
+			return "a label that is too long";
+		for (size_t idx = 0; idx < count; idx++)
+			label[idx] = cps[idx];
+		len = count;
+	} else {
+		const size_t prefix = sizeof(ACE_PREFIX) - 1;
+		memcpy(label, ACE_PREFIX, prefix);
+		const char * const error = punycode_encode(cps, count,
+		    label + prefix, &len, LABEL_MAX - prefix);
+		if (error != NULL)
+			return error;
+		len += prefix;
+	}
+
+	const size_t sep = *outlen > 0 ? 1 : 0;
+	if (*outlen + sep + len > DOMAIN_NAME_MAX)
+		return "too long";
+	if (sep)
+		out[(*outlen)++] = '.';
+	memcpy(out + *outlen, label, len);
+	*outlen += len;
+	return NULL;
+}
+
+/*
+ * Reduce a name to the domain that somebody registered: keep the last
+ * two labels, or three of them for the "co.uk"-style public suffixes.
+ * This is a heuristic; the full Public Suffix List is not consulted.
+ */
+static size_t
+registrable_domain(const char * const name, const size_t len)
+{
+	size_t dots[3];
+	size_t ndots = 0;
+	for (size_t idx = len; idx > 0 && ndots < 3; idx--)
+		if (name[idx - 1] == '.')
+			dots[ndots++] = idx - 1;
+
+	if (ndots < 2)
+		return 0;
+	const size_t tld_len = len - dots[0] - 1;
+	const char * const second = name + dots[1] + 1;
+	const size_t second_len = dots[0] - dots[1] - 1;
+	if (tld_len == 2)
+		for (size_t idx = 0; idx < CC_SECOND_LEVEL_COUNT; idx++)
+			if (strlen(cc_second_level[idx]) == second_len &&
+			    memcmp(cc_second_level[idx], second,
+			    second_len) == 0)
+				return ndots == 3 ? dots[2] + 1 : 0;
+	return dots[1] + 1;
+}
+
+/*
+ * Normalise a host name: lowercase it, IDNA-encode the labels that
+ * contain non-ASCII characters (no nameprep mapping is performed), and
+ * reduce it to the registrable domain.
+ */
+static const char *
+normalize(const char * const host, const size_t hostlen, char * const out,
+		size_t * const outlen)
+{
+	uint32_t cps[HOST_INPUT_MAX];
+	size_t count;
+	const char * const error = decode_utf8(host, hostlen, cps, &count);
+	if (error != NULL)
+		return error;
+	if (count > 0 && is_dot(cps[count - 1]))
+		count--;
+
+	size_t len = 0, nlabels = 0, label_start = 0;
+	for (size_t idx = 0; idx <= count; idx++) {
+		if (idx < count && !is_dot(cps[idx]))
+			continue;
+		const char * const lerror = append_label(cps + label_start,
+		    idx - label_start, out, &len);
+		if (lerror != NULL)
+			return lerror;
+		nlabels++;
+		label_start = idx + 1;
+	}
+
+	if (nlabels < 2)
+		return "not a registrable domain name";
+	size_t tld = len;
+	while (out[tld - 1] != '.')
+		tld--;
+	if (all_digits(out + tld, len - tld))
+		return "an IP address, not a domain name";
+
+	const size_t start = registrable_domain(out, len);
+	memmove(out, out + start, len - start);
+	*outlen = len - start;
+	out[*outlen] = '\0';
+	return NULL;
+}
+
+static bool
+add_name(struct domain_set * const set, const char * const raw,
+		const size_t len)
+{
+	const char *host;
+	size_t hostlen;
+	const char *error = extract_host(raw, len, &host, &hostlen);
+	if (error != NULL) {
+		warnx("Skipping '%.*s': %s", (int)len, raw, error);
+		return true;
+	}
+
+	/* Each different host name is only normalised once. */
+	struct name_table * const hosts = &set->hosts;
+	const uint64_t host_hash = sph_hash(SPH_HASH_INIT, host, hostlen);
+	const size_t host_slot = table_find(hosts, host, hostlen, host_hash);
+	uint32_t id;
+	if (hosts->slots[host_slot] != 0) {
+		id = hosts->names[hosts->slots[host_slot] - 1].value;
+	} else {
+		char name[DOMAIN_NAME_MAX + 1];
+		size_t name_len;
+		error = normalize(host, hostlen, name, &name_len);
+		if (error != NULL) {
+			warnx("Skipping '%.*s': %s",
+			    (int)hostlen, host, error);
+			id = NAME_NONE;
+		} else {
+			struct name_table * const names = &set->names;
+			const uint64_t hash =
+			    sph_hash(SPH_HASH_INIT, name, name_len);
+			const size_t slot =
+			    table_find(names, name, name_len, hash);
+			if (names->slots[slot] != 0) {
+				id = names->slots[slot] - 1;
+			} else {
+				id = table_add(names, name, name_len, hash,
+				    slot, 0);
+				if (id == NAME_NONE)
+					return false;
+				debug("Normalised '%.*s' to '%s'\n",
+				    (int)hostlen, host, name);
+			}
+		}
+		if (table_add(hosts, host, hostlen, host_hash, host_slot, id) ==
+		    NAME_NONE)
+			return false;
+	}
+
+	if (id != NAME_NONE) {
+		set->names.names[id].value++;
+		set->total++;
+	}
+	return true;
+}
+
+static bool
+read_names(struct domain_set * const set, FILE * const fp)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	bool ok = true;
+
+	while (ok && (len = getline(&line, &size, fp)) != -1) {
+		while (len > 0 && is_space(line[len - 1]))
+			len--;
+		if (len > 0)
+			ok = add_name(set, line, len);
+	}
+	if (ok && ferror(fp)) {
+		warn("Could not read the domain names");
+		ok = false;
+	}
+	free(line);
+	return ok;
+}
+
+static bool
+next_in_set(void * const data, uint32_t * const id)
+{
+	struct domain_set * const set = data;
+
+	if (set->next == set->names.count)
+		return false;
+	*id = set->next++;
+	return true;
+}
+
+static uint32_t *
+lookup_name(void * const data, const uint32_t id)
+{
+	const struct domain_set * const set = data;
+	const char * const name = table_string(&set->names, id);
+
+	char hostname[DOMAIN_NAME_MAX + 2];
+	const int len = snprintf(hostname, sizeof(hostname), "%s.%s",
+	    name, rbl_domain);
+	if (len < 0 || (size_t)len >= sizeof(hostname)) {
+		warnx("Cannot look up '%s' in %s: the name is too long",
+		    name, rbl_domain);
+		return NULL;
+	}
+	return query_hostname(hostname);
+}
+
+static const char *
+name_string(void * const data, const uint32_t id, char * const buf)
+{
+	(void)buf;
+	return table_string(&((const struct domain_set *)data)->names, id);
+}
+
+static uint32_t
+name_count(void * const data, const uint32_t id)
+{
+	return ((const struct domain_set *)data)->names.names[id].value;
+}
+
+int
+domain_check(const int nnames, char * const names[], const unsigned parallel,
+		const bool hostnames_only)
+{
+	struct domain_set set = { .total = 0 };
+	if (!table_init(&set.hosts))
+		return (1);
+	if (!table_init(&set.names)) {
+		table_free(&set.hosts);
+		return (1);
+	}
+
+	bool ok = true;
+	for (int idx = 0; ok && idx < nnames; idx++)
+		if (strcmp(names[idx], "-") == 0)
+			ok = read_names(&set, stdin);
+		else
+			ok = add_name(&set, names[idx], strlen(names[idx]));
+	table_free(&set.hosts);
+	if (!ok) {
+		table_free(&set.names);
+		return (1);
+	}
+
+	if (hostnames_only) {
+		for (size_t id = 0; id < set.names.count; id++)
+			printf("%s.%s\n", table_string(&set.names, id),
+			    rbl_domain);
+		table_free(&set.names);
+		return (0);
+	}
+
+	const struct sweep_source source = {
+		.next = next_in_set,
+		.lookup = lookup_name,
+		.data = &set,
+	};
+	struct sweep_result result = { 0 };
+	const bool completed = sweep(&source, parallel, &result);
+
+	printf("Found %zu domain names, %zu unique: %zu listed, %zu failed\n",
+	    set.total, set.names.count, result.listed, result.failed);
+	const struct sweep_ranking ranking = {
+		.name = name_string,
+		.count = name_count,
+		.data = &set,
+	};
+	const bool reported = sweep_report_ranked(&result, &ranking);
+	sweep_free(&result);
+	table_free(&set.names);
+	return (completed && reported ? 0 : 1);
+}
@@ -0,0 +1,477 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spahau.h"
+#include "sphhost.h"
+#include "sphfilter.h"
+
+#define FILTER_MAGIC		"SPHBLF1\n"
+#define FILTER_BYTE_ORDER	0x01020304U
+#define FILTER_MAX_HASHES	16
+
+/* One 512-bit block per cache line; all the bits for a key live in it. */
+#define FILTER_BLOCK_WORDS	8
+#define FILTER_BLOCK_BITS	(FILTER_BLOCK_WORDS * 64)
+#define FILTER_BITS_PER_HASH	7
+
+/* A blocked filter needs a bit more room than a classic one. */
+#define FILTER_BLOCK_OVERHEAD	1.2
+
+struct filter_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t hashes;
+	uint64_t blocks;
+	uint64_t prefixes;
+	uint64_t keys;
+	uint64_t reserved[3];
+};
+
+struct filter_keys {
+	uint64_t *keys;
+	size_t count;
+	size_t alloc;
+	uint64_t prefixes;
+};
+
+struct filter_location {
+	uint64_t block;
+	uint64_t seed;
+};
+
+static uint32_t
+netmask(const unsigned len)
+{
+	return (len == 0 ? 0 : 0xFFFFFFFFU << (32 - len));
+}
+
+static uint64_t
+mix64(uint64_t value)
+{
+	value ^= value >> 30;
+	value *= 0xBF58476D1CE4E5B9ULL;
+	value ^= value >> 27;
+	value *= 0x94D049BB133111EBULL;
+	value ^= value >> 31;
+	return value;
+}
+
+static struct filter_location
+locate(const uint64_t blocks, const uint32_t prefix, const unsigned len)
+{
+	const uint64_t hash = mix64(((uint64_t)prefix << 8) | len);
+
+	return (struct filter_location){
+		.block = ((hash >> 32) * blocks) >> 32,
+		.seed = hash,
+	};
+}
+
+/*
+ * Double hashing within a block this small makes too many keys share
+ * most of their bits, so take independent 9-bit chunks of a hash stream.
+ */
+static uint32_t
+bit_at(const struct filter_location * const loc, const uint32_t idx)
+{
+	const uint64_t bits = mix64(loc->seed +
+	    (idx / FILTER_BITS_PER_HASH + 1) * 0x9E3779B97F4A7C15ULL);
+	return ((bits >> (9 * (idx % FILTER_BITS_PER_HASH))) %
+	    FILTER_BLOCK_BITS);
+}
+
+static bool
+add_key(struct filter_keys * const keys, const uint32_t prefix,
+		const unsigned len)
+{
+	if (keys->count == keys->alloc) {
+		const size_t nalloc = keys->alloc == 0 ? 1024 : keys->alloc * 2;
+		uint64_t * const nkeys =
+		    realloc(keys->keys, nalloc * sizeof(*nkeys));
+		if (nkeys == NULL) {
+			warn("Could not allocate memory for %zu filter keys",
+			    nalloc);
+			return false;
+		}
+		keys->keys = nkeys;
+		keys->alloc = nalloc;
+	}
+
+	keys->keys[keys->count++] = ((uint64_t)prefix << 8) | len;
+	keys->prefixes |= (uint64_t)1 << len;
+	return true;
+}
+
+/* Split an arbitrary range into the CIDR blocks that make it up. */
+static bool
+add_range(struct filter_keys * const keys, const struct sph_range range)
+{
+	uint32_t first = range.first;
+
+	for (;;) {
+		unsigned len = 32;
+		while (len > 0 && (first & ~netmask(len - 1)) == 0 &&
+		    (first | ~netmask(len - 1)) <= range.last)
+			len--;
+		if (!add_key(keys, first, len))
+			return false;
+
+		const uint32_t block_last = first | ~netmask(len);
+		if (block_last >= range.last)
+			return true;
+		first = block_last + 1;
+	}
+}
+
+/* Parse a full or partial dotted-quad address, count the octets. */
+static const char *
+parse_zone_address(const char *ptr, uint32_t * const value,
+		unsigned * const count, unsigned long * const octet)
+{
+	*value = 0;
+	*count = 0;
+	for (;;) {
+		if (!isdigit((unsigned char)*ptr))
+			return NULL;
+		char *end;
+		*octet = strtoul(ptr, &end, 10);
+		if (*octet > 255)
+			return NULL;
+		*value |= (uint32_t)*octet << (24 - 8 * *count);
+		(*count)++;
+		ptr = end;
+		if (*ptr != '.' || *count == 4)
+			return ptr;
+		ptr++;
+	}
+}
+
+/*
+ * Parse an rbldnsd ip4set entry: a full or partial dotted-quad address,
+ * optionally followed by either a /prefix length, a -last value for
+ * the last octet specified, or a -a.b.c.d last address.
+ */
+static bool
+parse_zone_entry(const char * const entry, struct sph_range * const range)
+{
+	uint32_t value;
+	unsigned count;
+	unsigned long octet;
+	const char * const ptr =
+	    parse_zone_address(entry, &value, &count, &octet);
+	if (ptr == NULL)
+		return false;
+
+	const unsigned shift = 32 - 8 * count;
+	const uint32_t host = shift == 0 ? 0 : (1U << shift) - 1;
+	if (*ptr == '\0') {
+		range->first = value;
+		range->last = value | host;
+		return true;
+	}
+
+	if (*ptr == '-' && count == 4 && strchr(ptr + 1, '.') != NULL) {
+		uint32_t last;
+		unsigned last_count;
+		const char * const end =
+		    parse_zone_address(ptr + 1, &last, &last_count, &octet);
+		if (end == NULL || *end != '\0' || last_count != 4 ||
+		    last < value)
+			return false;
+		range->first = value;
+		range->last = last;
+		return true;
+	}
+
+	if (!isdigit((unsigned char)ptr[1]))
+		return false;
+	char *end;
+	const unsigned long num = strtoul(ptr + 1, &end, 10);
+	if (*end != '\0')
+		return false;
+	if (*ptr == '/') {
+		if (num > 32)
+			return false;
+		range->first = value & netmask(num);
+		range->last = range->first | ~netmask(num);
+		return true;
+	}
+	if (*ptr != '-' || num < octet || num > 255)
+		return false;
+	range->first = value;
+	range->last = (value & ~((uint32_t)0xFF << shift)) |
+	    ((uint32_t)num << shift) | host;
+	return true;
+}
+
+static bool
+read_zone(const char * const fname, struct filter_keys * const keys)
+{
+	debug("Reading the %s zone file\n", fname);
+	FILE * const fp = fopen(fname, "r");
+	if (fp == NULL) {
+		warn("Could not open %s", fname);
+		return false;
+	}
+
+	char *line = NULL;
+	size_t line_alloc = 0;
+	size_t lineno = 0, entries = 0;
+	bool ok = true;
+	while (ok && getline(&line, &line_alloc, fp) != -1) {
+		lineno++;
+		char *entry = line + strspn(line, " \t");
+		/* Comments, default values, directives, and exclusions. */
+		if (strchr("#:$!\r\n", *entry) != NULL)
+			continue;
+		entry[strcspn(entry, " \t\r\n:;")] = '\0';
+
+		struct sph_range range;
+		if (!parse_zone_entry(entry, &range)) {
+			warnx("%s:%zu: invalid entry '%s'", fname, lineno,
+			    entry);
+			ok = false;
+			break;
+		}
+		ok = add_range(keys, range);
+		entries++;
+	}
+	if (ok && ferror(fp)) {
+		warn("Could not read from %s", fname);
+		ok = false;
+	}
+	free(line);
+	fclose(fp);
+	debug("- got %zu entries, %zu keys so far\n", entries, keys->count);
+	return ok;
+}
+
+static void
+set_bits(uint64_t * const blocks, const struct filter_header * const hdr,
+		const uint64_t key)
+{
+	const struct filter_location loc =
+	    locate(hdr->blocks, (uint32_t)(key >> 8), key & 0xFF);
+	uint64_t * const block = &blocks[loc.block * FILTER_BLOCK_WORDS];
+
+	for (uint32_t idx = 0; idx < hdr->hashes; idx++) {
+		const uint32_t bit = bit_at(&loc, idx);
+		block[bit / 64] |= (uint64_t)1 << (bit % 64);
+	}
+}
+
+static bool
+write_filter(const char * const path, const struct filter_header * const hdr,
+		const uint64_t * const blocks)
+{
+	char *tmpname;
+	if (asprintf(&tmpname, "%s.tmp", path) == -1) {
+		warn("Could not allocate memory for the filename");
+		return false;
+	}
+
+	FILE * const fp = fopen(tmpname, "w");
+	if (fp == NULL) {
+		warn("Could not create %s", tmpname);
+		free(tmpname);
+		return false;
+	}
+	const size_t words = hdr->blocks * FILTER_BLOCK_WORDS;
+	const bool written = fwrite(hdr, sizeof(*hdr), 1, fp) == 1 &&
+	    fwrite(blocks, sizeof(*blocks), words, fp) == words;
+	if (fclose(fp) != 0 || !written) {
+		warn("Could not write to %s", tmpname);
+		unlink(tmpname);
+		free(tmpname);
+		return false;
+	}
+
+	/* Do not pull the rug from under anyone using the old one. */
+	if (rename(tmpname, path) == -1) {
+		warn("Could not rename %s to %s", tmpname, path);
+		unlink(tmpname);
+		free(tmpname);
+		return false;
+	}
+	free(tmpname);
+	return true;
+}
+
+bool
+filter_build(const char * const path, const double fp_rate, const int nzones,
+		char * const zones[])
+{
+	struct filter_keys keys = { 0 };
+	for (int idx = 0; idx < nzones; idx++)
+		if (!read_zone(zones[idx], &keys)) {
+			free(keys.keys);
+			return false;
+		}
+
+	/* Every prefix length present means one more probe per lookup. */
+	unsigned lengths = 0;
+	for (unsigned len = 0; len <= 32; len++)
+		if (keys.prefixes & ((uint64_t)1 << len))
+			lengths++;
+	const double probe_rate = lengths == 0 ? fp_rate : fp_rate / lengths;
+	const double hashes = ceil(-log2(probe_rate));
+	const double bits = FILTER_BLOCK_OVERHEAD * (double)keys.count *
+	    -log(probe_rate) / (log(2.0) * log(2.0));
+	const double blocks_needed = ceil(bits / FILTER_BLOCK_BITS);
+
+	const struct filter_header hdr = {
+		.magic = FILTER_MAGIC,
+		.byte_order = FILTER_BYTE_ORDER,
+		.hashes = hashes < 1 ? 1 :
+		    hashes > FILTER_MAX_HASHES ? FILTER_MAX_HASHES :
+		    (uint32_t)hashes,
+		.blocks = blocks_needed < 1 ? 1 : (uint64_t)blocks_needed,
+		.prefixes = keys.prefixes,
+		.keys = keys.count,
+	};
+	debug("Building a filter with %zu keys, %u prefix lengths, "
+	    "%" PRIu64 " blocks, %u hashes\n",
+	    keys.count, lengths, hdr.blocks, hdr.hashes);
+
+	uint64_t * const blocks =
+	    calloc(hdr.blocks * FILTER_BLOCK_WORDS, sizeof(*blocks));
+	if (blocks == NULL) {
+		warn("Could not allocate memory for %" PRIu64 " filter blocks",
+		    hdr.blocks);
+		free(keys.keys);
+		return false;
+	}
+	for (size_t idx = 0; idx < keys.count; idx++)
+		set_bits(blocks, &hdr, keys.keys[idx]);
+	free(keys.keys);
+
+	const bool written = write_filter(path, &hdr, blocks);
+	free(blocks);
+	return written;
+}
+
+bool
+filter_open(const char * const path, struct sph_filter * const filter)
+{
+	debug("About to load the %s prefilter\n", path);
+	const int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		warn("Could not open %s", path);
+		return false;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) == -1) {
+		warn("Could not examine %s", path);
+		close(fd);
+		return false;
+	}
+	if ((size_t)sb.st_size < sizeof(struct filter_header)) {
+		warnx("%s is too short to be a spahau prefilter", path);
+		close(fd);
+		return false;
+	}
+
+	void * const map =
+	    mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		warn("Could not map %s into memory", path);
+		return false;
+	}
+
+	const struct filter_header * const hdr = map;
+	if (memcmp(hdr->magic, FILTER_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->byte_order != FILTER_BYTE_ORDER ||
+	    hdr->hashes < 1 || hdr->hashes > FILTER_MAX_HASHES ||
+	    hdr->blocks == 0 || hdr->blocks > UINT32_MAX ||
+	    (uint64_t)sb.st_size != sizeof(*hdr) +
+	    hdr->blocks * FILTER_BLOCK_WORDS * sizeof(uint64_t)) {
+		warnx("%s is not a valid spahau prefilter for this system",
+		    path);
+		munmap(map, sb.st_size);
+		return false;
+	}
+	debug("- %" PRIu64 " keys, %" PRIu64 " blocks, %u hashes\n",
+	    hdr->keys, hdr->blocks, hdr->hashes);
+
+	*filter = (struct sph_filter){
+		.map = map,
+		.size = sb.st_size,
+		.header = hdr,
+		.blocks = (const uint64_t *)(hdr + 1),
+	};
+	return true;
+}
+
+bool
+filter_maybe_listed(const struct sph_filter * const filter,
+		const uint32_t address)
+{
+	const struct filter_header * const hdr = filter->header;
+
+	for (unsigned len = 0; len <= 32; len++) {
+		if (!(hdr->prefixes & ((uint64_t)1 << len)))
+			continue;
+
+		const struct filter_location loc =
+		    locate(hdr->blocks, address & netmask(len), len);
+		const uint64_t * const block =
+		    &filter->blocks[loc.block * FILTER_BLOCK_WORDS];
+		bool found = true;
+		for (uint32_t idx = 0; found && idx < hdr->hashes; idx++) {
+			const uint32_t bit = bit_at(&loc, idx);
+			found = (block[bit / 64] >> (bit % 64)) & 1;
+		}
+		if (found)
+			return true;
+	}
+	return false;
+}
+
+void
+filter_close(struct sph_filter * const filter)
+{
+	munmap(filter->map, filter->size);
+	*filter = (struct sph_filter){ 0 };
+}
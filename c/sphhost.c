@@ -31,9 +31,12 @@
 #include <arpa/inet.h>
 
 #include <err.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "spahau.h"
 #include "sphhost.h"
@@ -69,6 +72,84 @@ sph_pton(const char * const address, uint32_t * const result)
 	return true;
 }
 
+void
+sph_ntop(const uint32_t value, char * const buf)
+{
+	snprintf(buf, SPH_ADDRSTRLEN, "%u.%u.%u.%u",
+	    value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF,
+	    value & 0xFF);
+}
+
+bool
+sph_parse_range(const char * const spec, struct sph_range * const range)
+{
+	debug("About to parse the '%s' address range\n", spec);
+	const char * const slash = strchr(spec, '/');
+	if (slash == NULL) {
+		if (!sph_pton(spec, &range->first))
+			return false;
+		range->last = range->first;
+		return true;
+	}
+
+	char address[SPH_ADDRSTRLEN];
+	const size_t len = (size_t)(slash - spec);
+	if (len >= sizeof(address)) {
+		warnx("Invalid address range '%s'", spec);
+		return false;
+	}
+	memcpy(address, spec, len);
+	address[len] = '\0';
+
+	char *end;
+	const unsigned long prefix = strtoul(slash + 1, &end, 10);
+	if (slash[1] < '0' || slash[1] > '9' || *end != '\0' || prefix > 32) {
+		warnx("Invalid prefix length in the '%s' address range", spec);
+		return false;
+	}
+
+	uint32_t value;
+	if (!sph_pton(address, &value))
+		return false;
+	const uint32_t mask =
+	    prefix == 0 ? 0 : 0xFFFFFFFFU << (32 - prefix);
+	range->first = value & mask;
+	range->last = range->first | ~mask;
+	debug("- got %08X-%08X\n", range->first, range->last);
+	return true;
+}
+
+bool
+sph_parse_server(const char * const spec, uint32_t * const address,
+		uint16_t * const port)
+{
+	debug("About to parse the '%s' server address\n", spec);
+	const char * const colon = strchr(spec, ':');
+	if (colon == NULL)
+		return sph_pton(spec, address);
+
+	char text[SPH_ADDRSTRLEN];
+	const size_t len = (size_t)(colon - spec);
+	if (len >= sizeof(text)) {
+		warnx("Invalid server address '%s'", spec);
+		return false;
+	}
+	memcpy(text, spec, len);
+	text[len] = '\0';
+
+	char *end;
+	const unsigned long value = strtoul(colon + 1, &end, 10);
+	if (colon[1] < '0' || colon[1] > '9' || *end != '\0' ||
+	    value < 1 || value > UINT16_MAX) {
+		warnx("Invalid port number in the '%s' server address", spec);
+		return false;
+	}
+	if (!sph_pton(text, address))
+		return false;
+	*port = value;
+	return true;
+}
+
 char *sph_get_hostname(const char *address)
 {
 	debug("About to convert '%s' to an RBL hostname for '%s'\n",
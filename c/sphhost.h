@@ -27,7 +27,18 @@
  * SUCH DAMAGE.
  */
 
+/* Room for a dotted-quad address and the terminating null character. */
+#define SPH_ADDRSTRLEN	16
+
+struct sph_range {
+	uint32_t first;
+	uint32_t last;
+};
+
 bool sph_pton(const char *address, uint32_t *result);
+void sph_ntop(uint32_t value, char *buf);
+bool sph_parse_range(const char *spec, struct sph_range *range);
+bool sph_parse_server(const char *spec, uint32_t *address, uint16_t *port);
 
 char *sph_get_hostname(const char *address);
 
@@ -0,0 +1,387 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spahau.h"
+#include "sphhost.h"
+#include "sphjournal.h"
+#include "sphquery.h"
+#include "sphsweep.h"
+#include "sphutil.h"
+
+/* The position, the item, the count, the codes, and the checksum. */
+#define RECORD_SIZE(count)	(8 + 4 + 1 + 4 * (size_t)(count) + 4)
+#define RECORD_SIZE_MAX		RECORD_SIZE(RESPONSE_SIZE - 1)
+
+struct in_flight {
+	uint64_t position;
+	uint32_t item;
+	bool used;
+};
+
+struct sph_journal {
+	const char *path;
+	FILE *fp;
+	int fd;
+	bool failed;
+	time_t synced;
+
+	/*
+	 * The records are written out under the sweep lock, but the next
+	 * lookup started after that does the slow fsync() without holding it.
+	 */
+	pthread_mutex_t sync_lock;
+	bool sync_due;
+	bool sync_failed;
+
+	/* One bit for each input position already in the journal. */
+	uint8_t *bitmap;
+	uint64_t total;
+
+	const struct sweep_source *inner;
+	uint64_t position;
+	struct in_flight in_flight[SWEEP_PARALLEL_MAX];
+};
+
+static uint32_t
+checksum(const unsigned char * const data, const size_t len)
+{
+	/* Enough to spot a record that was cut short. */
+	return sph_hash(SPH_HASH_INIT, data, len) & 0xFFFFFFFFU;
+}
+
+static bool
+is_journaled(const struct sph_journal * const journal, const uint64_t position)
+{
+	return (journal->bitmap[position / 8] >> (position % 8)) & 1;
+}
+
+static void
+mark_journaled(struct sph_journal * const journal, const uint64_t position)
+{
+	journal->bitmap[position / 8] |= 1 << (position % 8);
+}
+
+static bool
+write_header(struct sph_journal * const journal, const uint64_t config_hash)
+{
+	unsigned char header[JOURNAL_HEADER_SIZE] = { 0 };
+	memcpy(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1);
+	sph_put32(header + 8, JOURNAL_VERSION);
+	sph_put64(header + 16, config_hash);
+	sph_put64(header + 24, journal->total);
+	if (fwrite(header, sizeof(header), 1, journal->fp) != 1 ||
+	    fflush(journal->fp) == EOF || fsync(fileno(journal->fp)) == -1) {
+		warn("Could not write to %s", journal->path);
+		return false;
+	}
+	return true;
+}
+
+static bool
+check_header(const struct sph_journal * const journal,
+		const uint64_t config_hash)
+{
+	unsigned char header[JOURNAL_HEADER_SIZE];
+	if (fread(header, sizeof(header), 1, journal->fp) != 1 ||
+	    memcmp(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) - 1) != 0 ||
+	    sph_get32(header + 8) != JOURNAL_VERSION) {
+		warnx("%s is not a valid spahau journal", journal->path);
+		return false;
+	}
+	if (sph_get64(header + 16) != config_hash ||
+	    sph_get64(header + 24) != journal->total) {
+		warnx("%s was written for different address ranges or "
+		    "a different RBL domain", journal->path);
+		return false;
+	}
+	return true;
+}
+
+/* Read the completed lookups, drop a partially written last record. */
+static bool
+replay(struct sph_journal * const journal, struct sweep_result * const replayed)
+{
+	unsigned char rec[RECORD_SIZE_MAX];
+	off_t offset = JOURNAL_HEADER_SIZE;
+	size_t count = 0;
+
+	for (;;) {
+		const size_t fixed = RECORD_SIZE(0) - 4;
+		const size_t got = fread(rec, 1, fixed, journal->fp);
+		if (got == 0)
+			break;
+		size_t size = 0;
+		if (got == fixed && rec[12] < RESPONSE_SIZE) {
+			size = RECORD_SIZE(rec[12]);
+			if (fread(rec + fixed, 1, size - fixed, journal->fp) !=
+			    size - fixed ||
+			    sph_get32(rec + size - 4) != checksum(rec, size - 4) ||
+			    sph_get64(rec) >= journal->total)
+				size = 0;
+		}
+		if (size == 0) {
+			warnx("Discarding a partial record at the end of %s",
+			    journal->path);
+			if (ftruncate(fileno(journal->fp), offset) == -1) {
+				warn("Could not truncate %s", journal->path);
+				return false;
+			}
+			break;
+		}
+		offset += size;
+
+		const uint64_t position = sph_get64(rec);
+		if (is_journaled(journal, position))
+			continue;
+		mark_journaled(journal, position);
+
+		uint32_t responses[RESPONSE_SIZE];
+		responses[0] = rec[12];
+		for (size_t idx = 1; idx <= responses[0]; idx++)
+			responses[idx] = sph_get32(rec + 13 + 4 * (idx - 1));
+		if (!sweep_record(replayed, sph_get32(rec + 8), responses)) {
+			warnx("Could not replay the %s journal", journal->path);
+			return false;
+		}
+		count++;
+	}
+	if (ferror(journal->fp)) {
+		warn("Could not read %s", journal->path);
+		return false;
+	}
+	debug("- replayed %zu completed lookups\n", count);
+	return fseeko(journal->fp, offset, SEEK_SET) == 0;
+}
+
+static void
+free_journal(struct sph_journal * const journal)
+{
+	if (journal->fp != NULL)
+		fclose(journal->fp);
+	free(journal->bitmap);
+	pthread_mutex_destroy(&journal->sync_lock);
+	free(journal);
+}
+
+struct sph_journal *
+journal_open(const char * const path, const uint64_t config_hash,
+		const uint64_t total, struct sweep_result * const replayed)
+{
+	debug("About to open the %s journal for %" PRIu64 " items\n",
+	    path, total);
+	struct sph_journal * const journal = calloc(1, sizeof(*journal));
+	if (journal == NULL) {
+		warn("Could not allocate memory for the journal");
+		return NULL;
+	}
+	journal->path = path;
+	journal->total = total;
+	pthread_mutex_init(&journal->sync_lock, NULL);
+	journal->synced = time(NULL);
+	journal->bitmap = calloc(total / 8 + 1, 1);
+	if (journal->bitmap == NULL) {
+		warn("Could not allocate memory for the journal");
+		free_journal(journal);
+		return NULL;
+	}
+
+	const int fd = open(path, O_RDWR | O_CREAT, 0666);
+	if (fd == -1) {
+		warn("Could not open %s", path);
+		free_journal(journal);
+		return NULL;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) == -1) {
+		warn("Could not examine %s", path);
+		close(fd);
+		free_journal(journal);
+		return NULL;
+	}
+	journal->fd = fd;
+	journal->fp = fdopen(fd, "r+");
+	if (journal->fp == NULL) {
+		warn("Could not open %s", path);
+		close(fd);
+		free_journal(journal);
+		return NULL;
+	}
+
+	const bool ok = sb.st_size == 0 ?
+	    write_header(journal, config_hash) :
+	    check_header(journal, config_hash) && replay(journal, replayed);
+	if (!ok) {
+		free_journal(journal);
+		return NULL;
+	}
+	return journal;
+}
+
+static bool
+journal_next(void * const data, uint32_t * const item)
+{
+	struct sph_journal * const journal = data;
+	const struct sweep_source * const inner = journal->inner;
+
+	for (;;) {
+		if (!inner->next(inner->data, item))
+			return false;
+		const uint64_t position = journal->position++;
+		if (is_journaled(journal, position))
+			continue;
+
+		/* There are never more lookups in flight than workers. */
+		for (size_t idx = 0; idx < SWEEP_PARALLEL_MAX; idx++)
+			if (!journal->in_flight[idx].used) {
+				journal->in_flight[idx] = (struct in_flight){
+					.position = position,
+					.item = *item,
+					.used = true,
+				};
+				break;
+			}
+		return true;
+	}
+}
+
+static uint32_t *
+journal_lookup(void * const data, const uint32_t item)
+{
+	struct sph_journal * const journal = data;
+
+	pthread_mutex_lock(&journal->sync_lock);
+	const bool sync_due = journal->sync_due;
+	journal->sync_due = false;
+	pthread_mutex_unlock(&journal->sync_lock);
+	if (sync_due && fsync(journal->fd) == -1) {
+		warn("Could not write to %s", journal->path);
+		pthread_mutex_lock(&journal->sync_lock);
+		journal->sync_failed = true;
+		pthread_mutex_unlock(&journal->sync_lock);
+	}
+
+	const struct sweep_source * const inner = journal->inner;
+	if (inner->lookup != NULL)
+		return inner->lookup(inner->data, item);
+	char text[SPH_ADDRSTRLEN];
+	sph_ntop(item, text);
+	return query(text);
+}
+
+static void
+append(struct sph_journal * const journal, const uint64_t position,
+		const uint32_t item, const uint32_t * const responses)
+{
+	unsigned char rec[RECORD_SIZE_MAX];
+	const size_t size = RECORD_SIZE(responses[0]);
+	sph_put64(rec, position);
+	sph_put32(rec + 8, item);
+	rec[12] = responses[0];
+	for (size_t idx = 1; idx <= responses[0]; idx++)
+		sph_put32(rec + 13 + 4 * (idx - 1), responses[idx]);
+	sph_put32(rec + size - 4, checksum(rec, size - 4));
+
+	if (fwrite(rec, size, 1, journal->fp) != 1) {
+		warn("Could not write to %s", journal->path);
+		journal->failed = true;
+		return;
+	}
+	const time_t now = time(NULL);
+	if (now - journal->synced >= JOURNAL_SYNC_INTERVAL) {
+		if (fflush(journal->fp) == EOF) {
+			warn("Could not write to %s", journal->path);
+			journal->failed = true;
+			return;
+		}
+		pthread_mutex_lock(&journal->sync_lock);
+		journal->sync_due = true;
+		pthread_mutex_unlock(&journal->sync_lock);
+		journal->synced = now;
+	}
+}
+
+static void
+journal_done(void * const data, const uint32_t item,
+		const uint32_t * const responses)
+{
+	struct sph_journal * const journal = data;
+
+	for (size_t idx = 0; idx < SWEEP_PARALLEL_MAX; idx++) {
+		struct in_flight * const flight = &journal->in_flight[idx];
+		if (!flight->used || flight->item != item)
+			continue;
+		flight->used = false;
+		/* Failed lookups and errors will be retried the next time. */
+		if (responses != NULL && !(responses[0] == 1 &&
+		    IS_SPAMHAUS_ERROR(responses[1])) && !journal->failed)
+			append(journal, flight->position, item, responses);
+		break;
+	}
+	if (journal->inner->done != NULL)
+		journal->inner->done(journal->inner->data, item, responses);
+}
+
+struct sweep_source
+journal_source(struct sph_journal * const journal,
+		const struct sweep_source * const inner)
+{
+	journal->inner = inner;
+	journal->position = 0;
+	return (struct sweep_source){
+		.next = journal_next,
+		.lookup = journal_lookup,
+		.done = journal_done,
+		.data = journal,
+	};
+}
+
+bool
+journal_close(struct sph_journal * const journal)
+{
+	bool ok = !journal->failed && !journal->sync_failed;
+	if (ok && (fflush(journal->fp) == EOF ||
+	    fsync(fileno(journal->fp)) == -1)) {
+		warn("Could not write to %s", journal->path);
+		ok = false;
+	}
+	free_journal(journal);
+	return ok;
+}
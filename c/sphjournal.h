@@ -0,0 +1,56 @@
+#ifndef INCLUDED_SPH_JOURNAL_H
+#define INCLUDED_SPH_JOURNAL_H
+
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * A journal file starts with a JOURNAL_HEADER_SIZE header: the magic
+ * string, a 32-bit version number, a 32-bit reserved field, the 64-bit
+ * hash of the run's configuration, and the 64-bit number of input items.
+ * Each record holds the 64-bit input position, the 32-bit item, the 8-bit
+ * number of response codes, the 32-bit codes themselves, and a 32-bit
+ * checksum of all the preceding fields. All the integers are in network
+ * byte order.
+ */
+#define JOURNAL_MAGIC		"SPHJRN1\n"
+#define JOURNAL_VERSION		1
+#define JOURNAL_HEADER_SIZE	32
+
+/* Make sure the journal is on disk at least this often (seconds). */
+#define JOURNAL_SYNC_INTERVAL	1
+
+struct sph_journal;
+struct sweep_result;
+struct sweep_source;
+
+struct sph_journal *journal_open(const char *path, uint64_t config_hash,
+		uint64_t total, struct sweep_result *replayed);
+struct sweep_source journal_source(struct sph_journal *journal,
+		const struct sweep_source *inner);
+bool journal_close(struct sph_journal *journal);
+
+#endif
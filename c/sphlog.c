@@ -0,0 +1,336 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "spahau.h"
+#include "sphhost.h"
+#include "sphlog.h"
+#include "sphsweep.h"
+#include "sphutil.h"
+
+#define SET_BITS_INITIAL	12
+
+struct addr_count {
+	uint32_t address;
+	uint32_t count;
+};
+
+struct addr_set {
+	struct addr_count *slots;
+	unsigned bits;
+	size_t used;
+	size_t total;
+	size_t next;
+};
+
+static size_t
+slot_for(const struct addr_set * const set, const uint32_t address)
+{
+	const size_t mask = ((size_t)1 << set->bits) - 1;
+	size_t idx = SPH_HASH_SLOT(address, set->bits);
+
+	while (set->slots[idx].count != 0 && set->slots[idx].address != address)
+		idx = (idx + 1) & mask;
+	return idx;
+}
+
+static bool
+set_init(struct addr_set * const set, const unsigned bits)
+{
+	*set = (struct addr_set){
+		.slots = calloc((size_t)1 << bits, sizeof(*set->slots)),
+		.bits = bits,
+	};
+	if (set->slots == NULL) {
+		warn("Could not allocate memory for %zu addresses",
+		    (size_t)1 << bits);
+		return false;
+	}
+	return true;
+}
+
+static bool
+set_grow(struct addr_set * const set)
+{
+	struct addr_set nset;
+	if (!set_init(&nset, set->bits + 1))
+		return false;
+
+	for (size_t idx = 0; idx < ((size_t)1 << set->bits); idx++)
+		if (set->slots[idx].count != 0)
+			nset.slots[slot_for(&nset, set->slots[idx].address)] =
+			    set->slots[idx];
+	nset.used = set->used;
+	nset.total = set->total;
+	free(set->slots);
+	*set = nset;
+	return true;
+}
+
+static bool
+set_add(struct addr_set * const set, const uint32_t address)
+{
+	struct addr_count *slot = &set->slots[slot_for(set, address)];
+
+	set->total++;
+	if (slot->count != 0) {
+		if (slot->count != UINT32_MAX)
+			slot->count++;
+		return true;
+	}
+
+	if (SPH_TABLE_OVERFULL(set->used + 1, set->bits)) {
+		if (!set_grow(set))
+			return false;
+		slot = &set->slots[slot_for(set, address)];
+	}
+	*slot = (struct addr_count){ .address = address, .count = 1 };
+	set->used++;
+	return true;
+}
+
+static uint32_t
+set_count(const struct addr_set * const set, const uint32_t address)
+{
+	return (set->slots[slot_for(set, address)].count);
+}
+
+static bool
+next_in_set(void * const data, uint32_t * const address)
+{
+	struct addr_set * const set = data;
+	const size_t size = (size_t)1 << set->bits;
+
+	while (set->next < size && set->slots[set->next].count == 0)
+		set->next++;
+	if (set->next == size)
+		return false;
+	*address = set->slots[set->next++].address;
+	return true;
+}
+
+/*
+ * Parse a bracketed dotted-quad address starting right after the '['.
+ * Anything else in brackets (process IDs, IPv6 addresses, etc.) is skipped.
+ */
+static bool
+parse_bracketed(const char *ptr, const char * const end,
+		uint32_t * const address)
+{
+	uint32_t value = 0;
+
+	for (unsigned idx = 0; idx < 4; idx++) {
+		unsigned octet = 0, digits = 0;
+		while (ptr < end && *ptr >= '0' && *ptr <= '9' && digits < 3) {
+			octet = octet * 10 + (unsigned)(*ptr - '0');
+			ptr++;
+			digits++;
+		}
+		if (digits == 0 || octet > 255 || ptr == end)
+			return false;
+		value = (value << 8) | octet;
+		if (*ptr != (idx == 3 ? ']' : '.'))
+			return false;
+		ptr++;
+	}
+	*address = value;
+	return true;
+}
+
+/* Find a string within a single line. */
+static const char *
+find_in_line(const char *ptr, const char * const end, const char * const str)
+{
+	const size_t len = strlen(str);
+
+	while ((size_t)(end - ptr) >= len &&
+	    (ptr = memchr(ptr, str[0], end - ptr - len + 1)) != NULL) {
+		if (memcmp(ptr, str, len) == 0)
+			return ptr + len;
+		ptr++;
+	}
+	return NULL;
+}
+
+/* Skip a host name up to the '[' right after it, if there is one. */
+static const char *
+skip_to_bracket(const char *ptr, const char * const end)
+{
+	while (ptr < end && *ptr != '[' && *ptr != ' ')
+		ptr++;
+	return ptr < end && *ptr == '[' ? ptr + 1 : NULL;
+}
+
+/*
+ * Find the client address in a single log line, if it records a new
+ * client: a Postfix "connect from host[a.b.c.d]" line (the rest of
+ * the session is not counted again), or an Exim "<=" message arrival line
+ * with a "H=host (helo) [a.b.c.d]" field. Other bracketed addresses,
+ * e.g. the relay=host[a.b.c.d] destination servers, are not clients.
+ */
+static bool
+client_address(const char * const line, const char * const end,
+		uint32_t * const address)
+{
+	const char *ptr = find_in_line(line, end, " connect from ");
+	if (ptr != NULL) {
+		ptr = skip_to_bracket(ptr, end);
+		return ptr != NULL && parse_bracketed(ptr, end, address);
+	}
+
+	ptr = find_in_line(line, end, " <= ");
+	if (ptr == NULL || (ptr = find_in_line(ptr, end, " H=")) == NULL)
+		return false;
+	if (ptr < end && *ptr != '(' && *ptr != '[')
+		while (ptr < end && *ptr != ' ')
+			ptr++;
+	while (ptr < end && *ptr == ' ')
+		ptr++;
+	/* The HELO name may be an address literal, too. */
+	if (ptr < end && *ptr == '(') {
+		ptr = memchr(ptr, ')', end - ptr);
+		if (ptr == NULL)
+			return false;
+		ptr++;
+		while (ptr < end && *ptr == ' ')
+			ptr++;
+	}
+	return ptr < end && *ptr == '[' &&
+	    parse_bracketed(ptr + 1, end, address);
+}
+
+static bool
+scan_file(const char * const fname, struct addr_set * const set)
+{
+	debug("About to scan %s\n", fname);
+	const int fd = open(fname, O_RDONLY);
+	if (fd == -1) {
+		warn("Could not open %s", fname);
+		return false;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) == -1) {
+		warn("Could not examine %s", fname);
+		close(fd);
+		return false;
+	}
+	if (!S_ISREG(sb.st_mode)) {
+		warnx("%s is not a regular file", fname);
+		close(fd);
+		return false;
+	}
+	if (sb.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	const size_t size = sb.st_size;
+	void * const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		warn("Could not map %s into memory", fname);
+		return false;
+	}
+	posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+	const char *line = map;
+	const char * const end = line + size;
+	const size_t before = set->total;
+	bool ok = true;
+	while (ok && line < end) {
+		const char *eol = memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		uint32_t address;
+		if (client_address(line, eol, &address))
+			ok = set_add(set, address);
+		line = eol < end ? eol + 1 : end;
+	}
+	munmap(map, size);
+	debug("- found %zu addresses, %zu unique so far\n",
+	    set->total - before, set->used);
+	return ok;
+}
+
+static const char *
+address_name(void * const data, const uint32_t address, char * const buf)
+{
+	(void)data;
+	sph_ntop(address, buf);
+	return buf;
+}
+
+static uint32_t
+address_count(void * const data, const uint32_t address)
+{
+	return (set_count(data, address));
+}
+
+int
+logscan(const int nfiles, char * const files[], const unsigned parallel)
+{
+	struct addr_set set;
+	if (!set_init(&set, SET_BITS_INITIAL))
+		return (1);
+	for (int idx = 0; idx < nfiles; idx++)
+		if (!scan_file(files[idx], &set)) {
+			free(set.slots);
+			return (1);
+		}
+
+	const struct sweep_source source = {
+		.next = next_in_set,
+		.data = &set,
+	};
+	struct sweep_result result = { 0 };
+	const bool completed = sweep(&source, parallel, &result);
+
+	printf("Found %zu client connections from %zu addresses: "
+	    "%zu listed, %zu failed\n",
+	    set.total, set.used, result.listed, result.failed);
+	const struct sweep_ranking ranking = {
+		.name = address_name,
+		.count = address_count,
+		.data = &set,
+	};
+	const bool reported = sweep_report_ranked(&result, &ranking);
+	sweep_free(&result);
+	free(set.slots);
+	return (completed && reported ? 0 : 1);
+}
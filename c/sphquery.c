@@ -24,19 +24,38 @@
  * SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <netinet/in.h>
+#include <arpa/nameser.h>
+
 #include <err.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <netdb.h>
+#include <poll.h>
+#include <resolv.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "spahau.h"
+#include "sphfilter.h"
 #include "sphhost.h"
 #include "sphquery.h"
+#include "sphtrace.h"
+
+/* Wait this long for an answer from the server specified with -s. */
+#define QUERY_TIMEOUT_MS	5000
+#define QUERY_TRIES		2
+
+static uint32_t *query_wire(const char *hostname, uint32_t *ttl);
 
 static int
 compare_uint32(const void * const a, const void * const b)
@@ -60,7 +79,7 @@ sort_uniq(uint32_t * const response)
 
 	uint32_t next_pos = 2;
 	uint32_t last_value = response[1];
-	for (uint32_t idx = 2; idx < response[0]; idx++) {
+	for (uint32_t idx = 2; idx <= start_count; idx++) {
 		if (response[idx] == last_value)
 			continue;
 		last_value = response[idx];
@@ -70,35 +89,50 @@ sort_uniq(uint32_t * const response)
 	response[0] = next_pos - 1;
 }
 
+static bool
+ruled_out(const char * const address)
+{
+	if (prefilter == NULL)
+		return false;
+
+	uint32_t value;
+	if (!sph_pton(address, &value) ||
+	    filter_maybe_listed(prefilter, value))
+		return false;
+	debug("- %s is not in the prefilter, no need to ask\n", address);
+	return true;
+}
+
 uint32_t *
-query(const char * const address)
+query_hostname(const char * const hostname)
 {
-	debug("About to query %s\n", address);
-	char * const hostname = sph_get_hostname(address);
+	debug("About to look up %s\n", hostname);
+	if (dns_server != NULL || dns_trace != NULL) {
+		uint32_t ttl;
+		return query_wire(hostname, &ttl);
+	}
 
 	uint32_t * const response = malloc(RESPONSE_SIZE * sizeof(*response));
 	if (response == NULL) {
 		warn("Could not allocate memory for the response");
-		free(hostname);
 		return NULL;
 	}
 
 	struct addrinfo hints = { 0 };
 	hints.ai_family = AF_INET;
-	struct addrinfo *resp;
-	const int res = getaddrinfo(hostname, NULL, &hints, &resp);
+	struct addrinfo *answer;
+	const int res = getaddrinfo(hostname, NULL, &hints, &answer);
 	if (res == EAI_NONAME) {
 		response[0] = 0;
-		free(hostname);
 		return response;
 	}
 	if (res != 0) {
 		warnx("Could not query '%s': %s", hostname, gai_strerror(res));
-		free(hostname);
+		free(response);
 		return NULL;
 	}
-	free(hostname);
 
+	const struct addrinfo *resp = answer;
 	size_t pos;
 	for (pos = 1; pos < RESPONSE_SIZE && resp != NULL;
 	    pos++, resp = resp->ai_next) {
@@ -108,6 +142,7 @@ query(const char * const address)
 			    "address family %d instead of %d",
 			    resp->ai_family, AF_INET);
 			response[0] = 0;
+			freeaddrinfo(answer);
 			return response;
 		}
 		if (resp->ai_addrlen != sizeof(struct sockaddr_in)) {
@@ -117,6 +152,7 @@ query(const char * const address)
 			    (size_t)resp->ai_addrlen,
 			    sizeof(struct sockaddr_in));
 			response[0] = 0;
+			freeaddrinfo(answer);
 			return response;
 		}
 		const uint8_t * const sinaddr = (const uint8_t *)&(((const struct sockaddr_in *)(resp->ai_addr))->sin_addr);
@@ -127,13 +163,251 @@ query(const char * const address)
 			response[1] = response[pos];
 			response[0] = 1;
 			debug("only returning the error code");
+			freeaddrinfo(answer);
 			return response;
 		}
 	}
 	debug("out of the loop with pos %zu\n", pos);
+	freeaddrinfo(answer);
 	response[0] = pos - 1;
 
 	if (response[0] > 1)
 		sort_uniq(response);
 	return response;
 }
+
+uint32_t *
+query(const char * const address)
+{
+	debug("About to query %s\n", address);
+	if (ruled_out(address)) {
+		uint32_t * const response =
+		    malloc(RESPONSE_SIZE * sizeof(*response));
+		if (response == NULL) {
+			warn("Could not allocate memory for the response");
+			return NULL;
+		}
+		response[0] = 0;
+		return response;
+	}
+
+	char * const hostname = sph_get_hostname(address);
+	if (hostname == NULL)
+		return NULL;
+	uint32_t * const response = query_hostname(hostname);
+	free(hostname);
+	return response;
+}
+
+static uint32_t
+negative_ttl(ns_msg * const msg)
+{
+	const int count = ns_msg_count(*msg, ns_s_ns);
+	for (int idx = 0; idx < count; idx++) {
+		ns_rr rr;
+		if (ns_parserr(msg, ns_s_ns, idx, &rr) == -1)
+			break;
+		if (ns_rr_type(rr) != ns_t_soa || ns_rr_rdlen(rr) < 4)
+			continue;
+
+		/* The SOA "minimum" field is the last one in the record. */
+		const uint32_t minimum =
+		    ns_get32(ns_rr_rdata(rr) + ns_rr_rdlen(rr) - 4);
+		return (ns_rr_ttl(rr) < minimum ? ns_rr_ttl(rr) : minimum);
+	}
+	debug("no SOA record in the authority section\n");
+	return 0;
+}
+
+static bool
+parse_answer(const char * const hostname, const unsigned char * const answer,
+		const int len, uint32_t * const response, uint32_t * const ttl)
+{
+	ns_msg msg;
+	if (ns_initparse(answer, len, &msg) == -1) {
+		warnx("Could not parse the response for '%s'", hostname);
+		return false;
+	}
+	const int rcode = ns_msg_getflag(msg, ns_f_rcode);
+	if (rcode != ns_r_noerror && rcode != ns_r_nxdomain) {
+		warnx("Could not query '%s': response code %d", hostname, rcode);
+		return false;
+	}
+
+	*ttl = UINT32_MAX;
+	size_t pos = 1;
+	const int count = ns_msg_count(msg, ns_s_an);
+	for (int idx = 0; idx < count; idx++) {
+		ns_rr rr;
+		if (ns_parserr(&msg, ns_s_an, idx, &rr) == -1) {
+			warnx("Could not parse a record for '%s'", hostname);
+			return false;
+		}
+		/* Any CNAME records expire along with the addresses. */
+		if (ns_rr_ttl(rr) < *ttl)
+			*ttl = ns_rr_ttl(rr);
+		if (ns_rr_type(rr) != ns_t_a || pos == RESPONSE_SIZE)
+			continue;
+		if (ns_rr_rdlen(rr) != 4) {
+			warnx("Got an address record of length %u for '%s'",
+			    ns_rr_rdlen(rr), hostname);
+			return false;
+		}
+
+		const uint8_t * const data = ns_rr_rdata(rr);
+		response[pos] = ((uint32_t)data[0] << 24) |
+		    (data[1] << 16) | (data[2] << 8) | data[3];
+		debug("- got %08X, TTL %u\n", response[pos], ns_rr_ttl(rr));
+
+		if (IS_SPAMHAUS_ERROR(response[pos])) {
+			response[1] = response[pos];
+			response[0] = 1;
+			debug("only returning the error code\n");
+			return true;
+		}
+		pos++;
+	}
+	response[0] = pos - 1;
+
+	if (response[0] == 0)
+		*ttl = negative_ttl(&msg);
+	else if (response[0] > 1)
+		sort_uniq(response);
+	debug("got %u responses, TTL %u\n", response[0], *ttl);
+	return true;
+}
+
+static bool
+matches_query(const unsigned char * const req,
+		const unsigned char * const answer, const ssize_t anslen)
+{
+	return anslen >= NS_HFIXEDSZ &&
+	    answer[0] == req[0] && answer[1] == req[1] && (answer[2] & 0x80);
+}
+
+/* Send the query to the server specified on the command line. */
+static int
+send_to_server(const char * const hostname, const unsigned char * const req,
+		const int reqlen, unsigned char * const answer, const int anssize)
+{
+	const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd == -1) {
+		warn("Could not create a socket to query '%s'", hostname);
+		return -1;
+	}
+	if (connect(fd, (const struct sockaddr *)dns_server,
+	    sizeof(*dns_server)) == -1) {
+		warn("Could not connect to the DNS server to query '%s'",
+		    hostname);
+		close(fd);
+		return -1;
+	}
+
+	for (int attempt = 0; attempt < QUERY_TRIES; attempt++) {
+		if (send(fd, req, reqlen, 0) == -1) {
+			warn("Could not send a query for '%s'", hostname);
+			break;
+		}
+
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int res;
+		while (res = poll(&pfd, 1, QUERY_TIMEOUT_MS), res > 0) {
+			const ssize_t len = recv(fd, answer, anssize, 0);
+			if (len == -1 && errno != ECONNREFUSED)
+				continue;
+			if (len == -1)
+				break;
+			if (matches_query(req, answer, len)) {
+				close(fd);
+				return len;
+			}
+			debug("- ignoring an unexpected answer\n");
+		}
+		if (res == -1 && errno != EINTR)
+			break;
+		debug("- no answer for %s, attempt %d\n", hostname, attempt + 1);
+	}
+	close(fd);
+	warnx("Could not query '%s': no answer from the DNS server", hostname);
+	return -1;
+}
+
+/* Send the query ourselves, record it if requested. */
+static uint32_t *
+query_wire(const char * const hostname, uint32_t * const ttl)
+{
+	uint32_t * const response = malloc(RESPONSE_SIZE * sizeof(*response));
+	if (response == NULL) {
+		warn("Could not allocate memory for the response");
+		return NULL;
+	}
+
+	unsigned char req[NS_PACKETSZ];
+	const int reqlen = res_mkquery(ns_o_query, hostname, ns_c_in, ns_t_a,
+	    NULL, 0, NULL, req, sizeof(req));
+	if (reqlen == -1) {
+		warnx("Could not build a query for '%s'", hostname);
+		free(response);
+		return NULL;
+	}
+
+	struct timespec sent, start, end;
+	clock_gettime(CLOCK_REALTIME, &sent);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	unsigned char answer[QUERY_ANSWER_SIZE];
+	int anslen;
+	if (dns_server != NULL) {
+		anslen = send_to_server(hostname, req, reqlen,
+		    answer, sizeof(answer));
+	} else {
+		anslen = res_send(req, reqlen, answer, sizeof(answer));
+		if (anslen == -1)
+			warnx("Could not query '%s'", hostname);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (anslen == -1) {
+		free(response);
+		return NULL;
+	}
+
+	const bool parsed =
+	    parse_answer(hostname, answer, anslen, response, ttl);
+	if (dns_trace != NULL) {
+		const int64_t latency =
+		    (int64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+		    (end.tv_nsec - start.tv_nsec) / 1000;
+		trace_record(dns_trace, &sent, latency, parsed ? *ttl : 0,
+		    req, reqlen, answer, anslen);
+	}
+	if (!parsed) {
+		free(response);
+		return NULL;
+	}
+	return response;
+}
+
+uint32_t *
+query_ttl(const char * const address, uint32_t * const ttl)
+{
+	debug("About to query %s and obtain the TTL\n", address);
+	if (ruled_out(address)) {
+		uint32_t * const response =
+		    malloc(RESPONSE_SIZE * sizeof(*response));
+		if (response == NULL) {
+			warn("Could not allocate memory for the response");
+			return NULL;
+		}
+		/* This will not change until the prefilter is rebuilt. */
+		response[0] = 0;
+		*ttl = UINT32_MAX;
+		return response;
+	}
+
+	char * const hostname = sph_get_hostname(address);
+	if (hostname == NULL)
+		return NULL;
+	/* getaddrinfo() does not expose the TTL. */
+	uint32_t * const response = query_wire(hostname, ttl);
+	free(hostname);
+	return response;
+}
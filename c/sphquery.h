@@ -32,6 +32,14 @@
 
 #define IS_SPAMHAUS_ERROR(resp)	(((resp) & 0xFFFFFF00) == 0x7FFFFF00)
 
+/* Large enough for any RBL answer received over UDP with EDNS0. */
+#define QUERY_ANSWER_SIZE	4096
+
+/* The port to send the queries to if -s does not specify one. */
+#define QUERY_PORT_DEFAULT	53
+
 uint32_t *query(const char *address);
+uint32_t *query_hostname(const char *hostname);
+uint32_t *query_ttl(const char *address, uint32_t *ttl);
 
 #endif
@@ -0,0 +1,308 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spahau.h"
+#include "sphhost.h"
+#include "sphquery.h"
+#include "sphresponse.h"
+#include "sphsweep.h"
+
+struct sweep_state {
+	pthread_mutex_t lock;
+	const struct sweep_source *source;
+	bool exhausted;
+	bool nomem;
+	struct sweep_result *result;
+};
+
+struct ranked {
+	uint32_t item;
+	uint32_t count;
+	size_t first_hit;
+	size_t hits;
+};
+
+static bool
+add_hit(struct sweep_result * const result, const uint32_t item,
+		const uint32_t response)
+{
+	if (result->hits_count == result->hits_alloc) {
+		const size_t nalloc =
+		    result->hits_alloc == 0 ? 64 : result->hits_alloc * 2;
+		struct sweep_hit * const nhits =
+		    realloc(result->hits, nalloc * sizeof(*nhits));
+		if (nhits == NULL) {
+			warn("Could not allocate memory for %zu results",
+			    nalloc);
+			return false;
+		}
+		result->hits = nhits;
+		result->hits_alloc = nalloc;
+	}
+
+	result->hits[result->hits_count++] = (struct sweep_hit){
+		.item = item,
+		.response = response,
+	};
+	return true;
+}
+
+bool
+sweep_record(struct sweep_result * const result, const uint32_t item,
+		const uint32_t * const responses)
+{
+	result->checked++;
+	if (responses == NULL) {
+		result->failed++;
+		return true;
+	}
+	if (responses[0] == 0)
+		return true;
+	/* An error code means that no real answer was obtained. */
+	if (IS_SPAMHAUS_ERROR(responses[1]))
+		result->failed++;
+	else
+		result->listed++;
+	for (size_t pos = 1; pos <= responses[0]; pos++)
+		if (!add_hit(result, item, responses[pos]))
+			return false;
+	return true;
+}
+
+static void *
+sweep_worker(void * const data)
+{
+	struct sweep_state * const state = data;
+	const struct sweep_source * const source = state->source;
+
+	for (;;) {
+		uint32_t item;
+
+		pthread_mutex_lock(&state->lock);
+		const bool have = !state->exhausted && !state->nomem &&
+		    source->next(source->data, &item);
+		if (!have)
+			state->exhausted = true;
+		pthread_mutex_unlock(&state->lock);
+		if (!have)
+			return NULL;
+
+		uint32_t *responses;
+		if (source->lookup != NULL) {
+			responses = source->lookup(source->data, item);
+		} else {
+			char text[SPH_ADDRSTRLEN];
+			sph_ntop(item, text);
+			responses = query(text);
+		}
+
+		pthread_mutex_lock(&state->lock);
+		if (!sweep_record(state->result, item, responses))
+			state->nomem = true;
+		if (source->done != NULL)
+			source->done(source->data, item, responses);
+		pthread_mutex_unlock(&state->lock);
+		free(responses);
+	}
+}
+
+bool
+sweep(const struct sweep_source * const source, const unsigned parallel,
+		struct sweep_result * const result)
+{
+	debug("About to start a sweep with %u queries in flight\n", parallel);
+
+	struct sweep_state state = {
+		.source = source,
+		.exhausted = false,
+		.nomem = false,
+		.result = result,
+	};
+	pthread_mutex_init(&state.lock, NULL);
+
+	pthread_t * const workers = malloc(parallel * sizeof(*workers));
+	if (workers == NULL) {
+		warn("Could not allocate memory for %u workers", parallel);
+		pthread_mutex_destroy(&state.lock);
+		return false;
+	}
+
+	unsigned started;
+	for (started = 0; started < parallel; started++) {
+		const int res = pthread_create(&workers[started], NULL,
+		    sweep_worker, &state);
+		if (res != 0) {
+			warnx("Could not start a sweep worker: %s",
+			    strerror(res));
+			break;
+		}
+	}
+	/* Even a single worker will get through the whole list. */
+	if (started == 0) {
+		free(workers);
+		pthread_mutex_destroy(&state.lock);
+		return false;
+	}
+	for (unsigned idx = 0; idx < started; idx++)
+		pthread_join(workers[idx], NULL);
+	free(workers);
+	pthread_mutex_destroy(&state.lock);
+
+	debug("Checked %zu addresses, %zu listed, %zu failed\n",
+	    result->checked, result->listed, result->failed);
+	return !state.nomem;
+}
+
+static int
+compare_hits(const void * const a, const void * const b)
+{
+	const struct sweep_hit * const ha = a;
+	const struct sweep_hit * const hb = b;
+
+	if (ha->response != hb->response)
+		return ha->response > hb->response ? 1 : -1;
+	if (ha->item != hb->item)
+		return ha->item > hb->item ? 1 : -1;
+	return 0;
+}
+
+static int
+compare_by_item(const void * const a, const void * const b)
+{
+	const struct sweep_hit * const ha = a;
+	const struct sweep_hit * const hb = b;
+
+	if (ha->item != hb->item)
+		return ha->item > hb->item ? 1 : -1;
+	if (ha->response != hb->response)
+		return ha->response > hb->response ? 1 : -1;
+	return 0;
+}
+
+static int
+compare_by_count(const void * const a, const void * const b)
+{
+	const struct ranked * const ra = a;
+	const struct ranked * const rb = b;
+
+	if (ra->count != rb->count)
+		return ra->count < rb->count ? 1 : -1;
+	if (ra->item != rb->item)
+		return ra->item > rb->item ? 1 : -1;
+	return 0;
+}
+
+void
+sweep_report(struct sweep_result * const result)
+{
+	printf("Checked %zu addresses: %zu listed, %zu failed\n",
+	    result->checked, result->listed, result->failed);
+
+	qsort(result->hits, result->hits_count, sizeof(*result->hits),
+	    compare_hits);
+	for (size_t idx = 0; idx < result->hits_count; idx++) {
+		const struct sweep_hit * const hit = &result->hits[idx];
+		if (idx == 0 || hit->response != result->hits[idx - 1].response) {
+			if (idx != 0)
+				printf("\n");
+			char * const resp = response_string(hit->response);
+			printf("%s:", resp != NULL ? resp : "(unknown)");
+			free(resp);
+		}
+
+		char text[SPH_ADDRSTRLEN];
+		sph_ntop(hit->item, text);
+		printf(" %s", text);
+	}
+	if (result->hits_count != 0)
+		printf("\n");
+}
+
+bool
+sweep_report_ranked(struct sweep_result * const result,
+		const struct sweep_ranking * const ranking)
+{
+	if (result->hits_count == 0)
+		return true;
+
+	qsort(result->hits, result->hits_count, sizeof(*result->hits),
+	    compare_by_item);
+	struct ranked * const ranks =
+	    malloc(result->hits_count * sizeof(*ranks));
+	if (ranks == NULL) {
+		warn("Could not allocate memory for %zu results",
+		    result->hits_count);
+		return false;
+	}
+	size_t count = 0;
+	for (size_t idx = 0; idx < result->hits_count; idx++) {
+		const uint32_t item = result->hits[idx].item;
+		if (count > 0 && ranks[count - 1].item == item) {
+			ranks[count - 1].hits++;
+			continue;
+		}
+		ranks[count++] = (struct ranked){
+			.item = item,
+			.count = ranking->count(ranking->data, item),
+			.first_hit = idx,
+			.hits = 1,
+		};
+	}
+	qsort(ranks, count, sizeof(*ranks), compare_by_count);
+
+	for (size_t idx = 0; idx < count; idx++) {
+		char buf[SPH_ADDRSTRLEN];
+		printf("%u %s:", ranks[idx].count,
+		    ranking->name(ranking->data, ranks[idx].item, buf));
+		for (size_t pos = 0; pos < ranks[idx].hits; pos++) {
+			char * const resp = response_string(
+			    result->hits[ranks[idx].first_hit + pos].response);
+			printf(" '%s'", resp != NULL ? resp : "(unknown)");
+			free(resp);
+		}
+		printf("\n");
+	}
+	free(ranks);
+	return true;
+}
+
+void
+sweep_free(struct sweep_result * const result)
+{
+	free(result->hits);
+	*result = (struct sweep_result){ 0 };
+}
@@ -0,0 +1,78 @@
+#ifndef INCLUDED_SPH_SWEEP_H
+#define INCLUDED_SPH_SWEEP_H
+
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define SWEEP_PARALLEL_DEFAULT	16
+#define SWEEP_PARALLEL_MAX	256
+
+/*
+ * Produce the next item to check; return false when exhausted.
+ * The items are addresses to query() unless a lookup function is
+ * specified; it will be invoked from several threads at once.
+ * The optional done function is told about each completed lookup
+ * (the responses are NULL if it failed); the calls are serialised.
+ */
+struct sweep_source {
+	bool (*next)(void *data, uint32_t *item);
+	uint32_t *(*lookup)(void *data, uint32_t item);
+	void (*done)(void *data, uint32_t item, const uint32_t *responses);
+	void *data;
+};
+
+/* Describe the listed items, the most frequently seen ones first. */
+struct sweep_ranking {
+	const char *(*name)(void *data, uint32_t item, char *buf);
+	uint32_t (*count)(void *data, uint32_t item);
+	void *data;
+};
+
+struct sweep_hit {
+	uint32_t item;
+	uint32_t response;
+};
+
+/* Initialise with { 0 }; the sweeps add to the counters and the hits. */
+struct sweep_result {
+	size_t checked;
+	size_t listed;
+	size_t failed;
+	struct sweep_hit *hits;
+	size_t hits_count;
+	size_t hits_alloc;
+};
+
+bool sweep(const struct sweep_source *source, unsigned parallel,
+		struct sweep_result *result);
+bool sweep_record(struct sweep_result *result, uint32_t item,
+		const uint32_t *responses);
+void sweep_report(struct sweep_result *result);
+bool sweep_report_ranked(struct sweep_result *result,
+		const struct sweep_ranking *ranking);
+void sweep_free(struct sweep_result *result);
+
+#endif
@@ -0,0 +1,586 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <resolv.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spahau.h"
+#include "sphquery.h"
+#include "sphtrace.h"
+#include "sphutil.h"
+
+struct sph_trace {
+	FILE *fp;
+	const char *path;
+	pthread_mutex_t lock;
+	bool failed;
+};
+
+struct replay_record {
+	char *name;
+	uint16_t type;
+	uint16_t class;
+	size_t idx;
+	uint32_t latency_us;
+	const unsigned char *answer;
+	size_t answer_len;
+};
+
+/* All the recorded answers for a single question, in the recorded order. */
+struct replay_question {
+	const struct replay_record *first;
+	size_t count;
+	size_t next;
+};
+
+struct pending {
+	uint64_t due;
+	struct sockaddr_in client;
+	const struct replay_record *record;
+	unsigned char id[2];
+};
+
+struct pending_heap {
+	struct pending *items;
+	size_t count;
+	size_t alloc;
+};
+
+struct sph_trace *
+trace_create(const char * const path)
+{
+	debug("About to record the DNS queries into %s\n", path);
+	struct sph_trace * const trace = malloc(sizeof(*trace));
+	if (trace == NULL) {
+		warn("Could not allocate memory for the trace");
+		return NULL;
+	}
+	FILE * const fp = fopen(path, "wb");
+	if (fp == NULL) {
+		warn("Could not create %s", path);
+		free(trace);
+		return NULL;
+	}
+
+	unsigned char header[TRACE_HEADER_SIZE] = { 0 };
+	memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1);
+	sph_put32(header + 8, TRACE_VERSION);
+	if (fwrite(header, sizeof(header), 1, fp) != 1) {
+		warn("Could not write to %s", path);
+		fclose(fp);
+		free(trace);
+		return NULL;
+	}
+
+	*trace = (struct sph_trace){
+		.fp = fp,
+		.path = path,
+		.failed = false,
+	};
+	pthread_mutex_init(&trace->lock, NULL);
+	return trace;
+}
+
+void
+trace_record(struct sph_trace * const trace, const struct timespec * const when,
+		const uint32_t latency_us, const uint32_t ttl,
+		const unsigned char * const query, const size_t query_len,
+		const unsigned char * const answer, const size_t answer_len)
+{
+	const uint64_t stamp =
+	    (uint64_t)when->tv_sec * 1000000 + when->tv_nsec / 1000;
+	unsigned char header[TRACE_RECORD_SIZE];
+	sph_put64(header, stamp);
+	sph_put32(header + 8, latency_us);
+	sph_put32(header + 12, ttl);
+	sph_put16(header + 16, query_len);
+	sph_put16(header + 18, answer_len);
+
+	pthread_mutex_lock(&trace->lock);
+	if (!trace->failed &&
+	    (fwrite(header, sizeof(header), 1, trace->fp) != 1 ||
+	    fwrite(query, query_len, 1, trace->fp) != 1 ||
+	    fwrite(answer, answer_len, 1, trace->fp) != 1)) {
+		warn("Could not write to %s", trace->path);
+		trace->failed = true;
+	}
+	pthread_mutex_unlock(&trace->lock);
+}
+
+void
+trace_flush(struct sph_trace * const trace)
+{
+	pthread_mutex_lock(&trace->lock);
+	if (!trace->failed && fflush(trace->fp) == EOF) {
+		warn("Could not write to %s", trace->path);
+		trace->failed = true;
+	}
+	pthread_mutex_unlock(&trace->lock);
+}
+
+bool
+trace_close(struct sph_trace * const trace)
+{
+	bool ok = !trace->failed;
+	if (fclose(trace->fp) == EOF && ok) {
+		warn("Could not write to %s", trace->path);
+		ok = false;
+	}
+	pthread_mutex_destroy(&trace->lock);
+	free(trace);
+	return ok;
+}
+
+static uint64_t
+monotonic_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Extract the question, return the offset right after it or 0. */
+static size_t
+parse_question(const unsigned char * const packet, const size_t len,
+		char * const name, uint16_t * const type, uint16_t * const class)
+{
+	if (len < NS_HFIXEDSZ || sph_get16(packet + 4) != 1)
+		return 0;
+	const int namelen = dn_expand(packet, packet + len,
+	    packet + NS_HFIXEDSZ, name, NS_MAXDNAME);
+	if (namelen < 0 || NS_HFIXEDSZ + (size_t)namelen + 4 > len)
+		return 0;
+	for (char *p = name; *p != '\0'; p++)
+		*p = tolower((unsigned char)*p);
+
+	const size_t pos = NS_HFIXEDSZ + namelen;
+	*type = sph_get16(packet + pos);
+	*class = sph_get16(packet + pos + 2);
+	return pos + 4;
+}
+
+static int
+compare_question(const char * const name, const uint16_t type,
+		const uint16_t class, const struct replay_record * const rec)
+{
+	const int res = strcmp(name, rec->name);
+	if (res != 0)
+		return res;
+	if (type != rec->type)
+		return type > rec->type ? 1 : -1;
+	if (class != rec->class)
+		return class > rec->class ? 1 : -1;
+	return 0;
+}
+
+static int
+compare_records(const void * const a, const void * const b)
+{
+	const struct replay_record * const ra = a;
+	const struct replay_record * const rb = b;
+
+	const int res = compare_question(ra->name, ra->type, ra->class, rb);
+	if (res != 0)
+		return res;
+	if (ra->idx != rb->idx)
+		return ra->idx > rb->idx ? 1 : -1;
+	return 0;
+}
+
+static int
+find_question(const void * const key, const void * const item)
+{
+	const struct replay_record * const rkey = key;
+	const struct replay_question * const question = item;
+
+	return compare_question(rkey->name, rkey->type, rkey->class,
+	    question->first);
+}
+
+static void
+free_records(struct replay_record * const records, const size_t count)
+{
+	for (size_t idx = 0; idx < count; idx++)
+		free(records[idx].name);
+	free(records);
+}
+
+/* Parse the trace records, sort them by question. */
+static struct replay_record *
+load_records(const char * const path, const unsigned char * const data,
+		const size_t size, size_t * const count)
+{
+	size_t alloc = 1024, used = 0;
+	struct replay_record *records = malloc(alloc * sizeof(*records));
+	if (records == NULL) {
+		warn("Could not allocate memory for the trace records");
+		return NULL;
+	}
+
+	size_t pos = TRACE_HEADER_SIZE;
+	while (pos < size) {
+		if (size - pos < TRACE_RECORD_SIZE) {
+			warnx("%s: truncated record at offset %zu", path, pos);
+			break;
+		}
+		const unsigned char * const header = data + pos;
+		const size_t query_len = sph_get16(header + 16);
+		const size_t answer_len = sph_get16(header + 18);
+		if (size - pos - TRACE_RECORD_SIZE < query_len + answer_len) {
+			warnx("%s: truncated record at offset %zu", path, pos);
+			break;
+		}
+		const unsigned char * const query = header + TRACE_RECORD_SIZE;
+		pos += TRACE_RECORD_SIZE + query_len + answer_len;
+
+		char name[NS_MAXDNAME];
+		uint16_t type, class;
+		if (parse_question(query, query_len, name, &type, &class) == 0 ||
+		    answer_len < NS_HFIXEDSZ) {
+			warnx("%s: skipping a malformed record", path);
+			continue;
+		}
+
+		if (used == alloc) {
+			alloc *= 2;
+			struct replay_record * const more =
+			    realloc(records, alloc * sizeof(*records));
+			if (more == NULL) {
+				warn("Could not allocate memory for "
+				    "%zu trace records", alloc);
+				free_records(records, used);
+				return NULL;
+			}
+			records = more;
+		}
+		char * const copy = strdup(name);
+		if (copy == NULL) {
+			warn("Could not allocate memory for the trace records");
+			free_records(records, used);
+			return NULL;
+		}
+		records[used] = (struct replay_record){
+			.name = copy,
+			.type = type,
+			.class = class,
+			.idx = used,
+			.latency_us = sph_get32(header + 8),
+			.answer = query + query_len,
+			.answer_len = answer_len,
+		};
+		used++;
+	}
+
+	qsort(records, used, sizeof(*records), compare_records);
+	*count = used;
+	return records;
+}
+
+static struct replay_question *
+group_records(const struct replay_record * const records, const size_t count,
+		size_t * const nquestions)
+{
+	struct replay_question * const questions =
+	    malloc((count > 0 ? count : 1) * sizeof(*questions));
+	if (questions == NULL) {
+		warn("Could not allocate memory for the trace questions");
+		return NULL;
+	}
+
+	size_t used = 0;
+	for (size_t idx = 0; idx < count; idx++) {
+		const struct replay_record * const rec = &records[idx];
+		if (used > 0 && compare_question(rec->name, rec->type,
+		    rec->class, questions[used - 1].first) == 0) {
+			questions[used - 1].count++;
+			continue;
+		}
+		questions[used++] = (struct replay_question){
+			.first = rec,
+			.count = 1,
+			.next = 0,
+		};
+	}
+	*nquestions = used;
+	return questions;
+}
+
+static bool
+heap_push(struct pending_heap * const heap, const struct pending * const item)
+{
+	if (heap->count == heap->alloc) {
+		const size_t alloc = heap->alloc == 0 ? 64 : heap->alloc * 2;
+		struct pending * const items =
+		    realloc(heap->items, alloc * sizeof(*items));
+		if (items == NULL) {
+			warn("Could not allocate memory for the pending answers");
+			return false;
+		}
+		heap->items = items;
+		heap->alloc = alloc;
+	}
+
+	size_t idx = heap->count++;
+	while (idx > 0) {
+		const size_t parent = (idx - 1) / 2;
+		if (heap->items[parent].due <= item->due)
+			break;
+		heap->items[idx] = heap->items[parent];
+		idx = parent;
+	}
+	heap->items[idx] = *item;
+	return true;
+}
+
+static void
+heap_pop(struct pending_heap * const heap)
+{
+	const struct pending last = heap->items[--heap->count];
+	size_t idx = 0;
+	for (;;) {
+		size_t child = 2 * idx + 1;
+		if (child >= heap->count)
+			break;
+		if (child + 1 < heap->count &&
+		    heap->items[child + 1].due < heap->items[child].due)
+			child++;
+		if (last.due <= heap->items[child].due)
+			break;
+		heap->items[idx] = heap->items[child];
+		idx = child;
+	}
+	heap->items[idx] = last;
+}
+
+static void
+send_answer(const int fd, const struct pending * const item)
+{
+	unsigned char buf[QUERY_ANSWER_SIZE];
+	const size_t len = item->record->answer_len < sizeof(buf) ?
+	    item->record->answer_len : sizeof(buf);
+	memcpy(buf, item->record->answer, len);
+	memcpy(buf, item->id, sizeof(item->id));
+	if (sendto(fd, buf, len, 0, (const struct sockaddr *)&item->client,
+	    sizeof(item->client)) == -1)
+		warn("Could not send an answer");
+}
+
+/* Echo the question back with a "server failure" response code. */
+static void
+send_failure(const int fd, unsigned char * const query,
+		const size_t question_end, const struct sockaddr_in * const client)
+{
+	query[2] |= 0x80;
+	query[3] = (query[3] & 0xF0) | ns_r_servfail;
+	memset(query + 6, 0, 6);
+	if (sendto(fd, query, question_end, 0,
+	    (const struct sockaddr *)client, sizeof(*client)) == -1)
+		warn("Could not send an answer");
+}
+
+static bool
+handle_query(const int fd, struct replay_question * const questions,
+		const size_t nquestions, struct pending_heap * const heap,
+		const bool full_speed)
+{
+	unsigned char query[QUERY_ANSWER_SIZE];
+	struct sockaddr_in client;
+	socklen_t client_len = sizeof(client);
+	const ssize_t len = recvfrom(fd, query, sizeof(query), 0,
+	    (struct sockaddr *)&client, &client_len);
+	if (len == -1) {
+		if (errno == EINTR || errno == EAGAIN)
+			return true;
+		warn("Could not receive a query");
+		return false;
+	}
+
+	char name[NS_MAXDNAME];
+	struct replay_record key = { .name = name };
+	const size_t question_end =
+	    parse_question(query, len, name, &key.type, &key.class);
+	if (question_end == 0) {
+		debug("- ignoring a malformed query\n");
+		return true;
+	}
+
+	struct replay_question * const question = bsearch(&key, questions,
+	    nquestions, sizeof(*questions), find_question);
+	if (question == NULL) {
+		debug("- no recorded answer for %s\n", name);
+		send_failure(fd, query, question_end, &client);
+		return true;
+	}
+
+	/* Serve the answers in order, then keep repeating the last one. */
+	const struct replay_record * const rec =
+	    &question->first[question->next];
+	if (question->next + 1 < question->count)
+		question->next++;
+	debug("- answering %s after %" PRIu32 " microseconds\n",
+	    name, full_speed ? 0 : rec->latency_us);
+
+	struct pending item = {
+		.due = monotonic_us() + (full_speed ? 0 : rec->latency_us),
+		.client = client,
+		.record = rec,
+	};
+	memcpy(item.id, query, sizeof(item.id));
+	if (full_speed) {
+		send_answer(fd, &item);
+		return true;
+	}
+	return heap_push(heap, &item);
+}
+
+static int
+serve(const int fd, struct replay_question * const questions,
+		const size_t nquestions, const bool full_speed)
+{
+	struct pending_heap heap = { .items = NULL };
+	for (;;) {
+		const uint64_t now = monotonic_us();
+		while (heap.count > 0 && heap.items[0].due <= now) {
+			send_answer(fd, &heap.items[0]);
+			heap_pop(&heap);
+		}
+
+		int timeout = -1;
+		if (heap.count > 0)
+			timeout = (heap.items[0].due - now + 999) / 1000;
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		const int res = poll(&pfd, 1, timeout);
+		if (res == -1 && errno != EINTR) {
+			warn("Could not wait for queries");
+			break;
+		}
+		if (res > 0 &&
+		    !handle_query(fd, questions, nquestions, &heap, full_speed))
+			break;
+	}
+	free(heap.items);
+	return (1);
+}
+
+int
+replay(const char * const path, const struct sockaddr_in * const addr,
+		const bool full_speed)
+{
+	debug("About to load the %s trace\n", path);
+	const int tfd = open(path, O_RDONLY);
+	if (tfd == -1) {
+		warn("Could not open %s", path);
+		return (1);
+	}
+	struct stat sb;
+	if (fstat(tfd, &sb) == -1) {
+		warn("Could not examine %s", path);
+		close(tfd);
+		return (1);
+	}
+	if ((size_t)sb.st_size < TRACE_HEADER_SIZE) {
+		warnx("%s is too short to be a spahau trace", path);
+		close(tfd);
+		return (1);
+	}
+	void * const map =
+	    mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, tfd, 0);
+	close(tfd);
+	if (map == MAP_FAILED) {
+		warn("Could not map %s into memory", path);
+		return (1);
+	}
+	const unsigned char * const data = map;
+	if (memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC) - 1) != 0 ||
+	    sph_get32(data + 8) != TRACE_VERSION) {
+		warnx("%s is not a valid spahau trace", path);
+		munmap(map, sb.st_size);
+		return (1);
+	}
+
+	size_t count, nquestions;
+	struct replay_record * const records =
+	    load_records(path, data, sb.st_size, &count);
+	if (records == NULL) {
+		munmap(map, sb.st_size);
+		return (1);
+	}
+	struct replay_question * const questions =
+	    group_records(records, count, &nquestions);
+	if (questions == NULL) {
+		free_records(records, count);
+		munmap(map, sb.st_size);
+		return (1);
+	}
+	debug("- %zu answers for %zu questions\n", count, nquestions);
+
+	int res = 1;
+	const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd == -1) {
+		warn("Could not create a socket");
+	} else if (bind(fd, (const struct sockaddr *)addr,
+	    sizeof(*addr)) == -1) {
+		warn("Could not listen on %s:%u",
+		    inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+		close(fd);
+	} else {
+		printf("Replaying %zu answers for %zu questions on %s:%u\n",
+		    count, nquestions,
+		    inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+		fflush(stdout);
+		res = serve(fd, questions, nquestions, full_speed);
+		close(fd);
+	}
+
+	free(questions);
+	free_records(records, count);
+	munmap(map, sb.st_size);
+	return (res);
+}
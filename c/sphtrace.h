@@ -0,0 +1,60 @@
+#ifndef INCLUDED_SPH_TRACE_H
+#define INCLUDED_SPH_TRACE_H
+
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * A trace file starts with a TRACE_HEADER_SIZE header: the magic string,
+ * followed by a 32-bit version number and a 32-bit reserved field.
+ * Each record consists of a TRACE_RECORD_SIZE header: a 64-bit timestamp
+ * (microseconds since the epoch), the 32-bit latency in microseconds,
+ * the 32-bit TTL of the answer, the 16-bit query length, and the 16-bit
+ * answer length, followed by the query and answer packets themselves.
+ * All the integers are in network byte order.
+ */
+#define TRACE_MAGIC		"SPHDNS1\n"
+#define TRACE_VERSION		1
+#define TRACE_HEADER_SIZE	16
+#define TRACE_RECORD_SIZE	20
+
+#define REPLAY_PORT_DEFAULT	5353
+
+struct sockaddr_in;
+struct sph_trace;
+struct timespec;
+
+struct sph_trace *trace_create(const char *path);
+void trace_record(struct sph_trace *trace, const struct timespec *when,
+		uint32_t latency_us, uint32_t ttl,
+		const unsigned char *query, size_t query_len,
+		const unsigned char *answer, size_t answer_len);
+void trace_flush(struct sph_trace *trace);
+bool trace_close(struct sph_trace *trace);
+
+int replay(const char *path, const struct sockaddr_in *addr, bool full_speed);
+
+#endif
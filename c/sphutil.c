@@ -0,0 +1,81 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "sphutil.h"
+
+uint64_t
+sph_hash(uint64_t hash, const void * const data, const size_t len)
+{
+	/* FNV-1a */
+	const unsigned char * const bytes = data;
+	for (size_t idx = 0; idx < len; idx++) {
+		hash ^= bytes[idx];
+		hash *= 0x100000001B3U;
+	}
+	return hash;
+}
+
+void
+sph_put16(unsigned char * const buf, const uint16_t value)
+{
+	buf[0] = value >> 8;
+	buf[1] = value & 0xFF;
+}
+
+void
+sph_put32(unsigned char * const buf, const uint32_t value)
+{
+	sph_put16(buf, value >> 16);
+	sph_put16(buf + 2, value & 0xFFFF);
+}
+
+void
+sph_put64(unsigned char * const buf, const uint64_t value)
+{
+	sph_put32(buf, value >> 32);
+	sph_put32(buf + 4, value & 0xFFFFFFFFU);
+}
+
+uint16_t
+sph_get16(const unsigned char * const buf)
+{
+	return (buf[0] << 8) | buf[1];
+}
+
+uint32_t
+sph_get32(const unsigned char * const buf)
+{
+	return ((uint32_t)sph_get16(buf) << 16) | sph_get16(buf + 2);
+}
+
+uint64_t
+sph_get64(const unsigned char * const buf)
+{
+	return ((uint64_t)sph_get32(buf) << 32) | sph_get32(buf + 4);
+}
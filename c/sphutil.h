@@ -0,0 +1,54 @@
+#ifndef INCLUDED_SPH_UTIL_H
+#define INCLUDED_SPH_UTIL_H
+
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* Chain several buffers through sph_hash() starting with this value. */
+#define SPH_HASH_INIT	0xCBF29CE484222325U
+
+/* Map a hash to one of the 2^bits slots of an open-addressing table. */
+#define SPH_HASH_SLOT(hash, bits) \
+	((size_t)(((uint64_t)(hash) * 0x9E3779B97F4A7C15U) >> (64 - (bits))))
+
+/*
+ * Keep the open-addressing tables at most half full so that the probe
+ * sequences stay short: grow them when this becomes true.
+ */
+#define SPH_TABLE_OVERFULL(used, bits) \
+	(2 * (used) > ((size_t)1 << (bits)))
+
+uint64_t sph_hash(uint64_t hash, const void *data, size_t len);
+
+/* Store and fetch integers in network byte order. */
+void sph_put16(unsigned char *buf, uint16_t value);
+void sph_put32(unsigned char *buf, uint32_t value);
+void sph_put64(unsigned char *buf, uint64_t value);
+uint16_t sph_get16(const unsigned char *buf);
+uint32_t sph_get32(const unsigned char *buf);
+uint64_t sph_get64(const unsigned char *buf);
+
+#endif
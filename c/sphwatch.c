@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spahau.h"
+#include "sphhost.h"
+#include "sphquery.h"
+#include "sphresponse.h"
+#include "sphsweep.h"
+#include "sphtrace.h"
+#include "sphwatch.h"
+
+/* One-second slots; later deadlines wrap around and wait their turn. */
+#define WHEEL_SIZE	1024
+#define WHEEL_NONE	SIZE_MAX
+
+struct watch_entry {
+	uint32_t address;
+	uint32_t *verdict;
+	uint32_t ttl;
+	bool seen;
+	uint64_t due;
+	size_t next;
+};
+
+struct watch_wheel {
+	struct watch_entry *entries;
+	size_t slots[WHEEL_SIZE];
+	uint64_t now;
+	uint32_t min_interval;
+	uint32_t max_interval;
+
+	/* The entries to check in the current slot. */
+	uint32_t *due;
+	size_t due_count;
+	size_t due_pos;
+};
+
+static void
+schedule(struct watch_wheel * const wheel, const size_t idx,
+		const uint64_t due)
+{
+	struct watch_entry * const entry = &wheel->entries[idx];
+	size_t * const slot = &wheel->slots[due % WHEEL_SIZE];
+
+	entry->due = due;
+	entry->next = *slot;
+	*slot = idx;
+}
+
+static bool
+same_verdict(const uint32_t * const a, const uint32_t * const b)
+{
+	const uint32_t a_count = a == NULL ? 0 : a[0];
+	const uint32_t b_count = b == NULL ? 0 : b[0];
+
+	if (a_count != b_count)
+		return false;
+	for (uint32_t idx = 1; idx <= a_count; idx++)
+		if (a[idx] != b[idx])
+			return false;
+	return true;
+}
+
+static void
+report_transition(const char * const text, const uint32_t * const verdict)
+{
+	if (verdict[0] == 0) {
+		printf("%s: no longer listed\n", text);
+	} else {
+		printf("%s: now listed:", text);
+		for (size_t pos = 1; pos <= verdict[0]; pos++) {
+			char * const resp = response_string(verdict[pos]);
+			printf(" '%s'", resp != NULL ? resp : "(unknown)");
+			free(resp);
+		}
+		printf("\n");
+	}
+	/* Somebody may be waiting for this on the other side of a pipe. */
+	fflush(stdout);
+}
+
+static bool
+next_due(void * const data, uint32_t * const item)
+{
+	struct watch_wheel * const wheel = data;
+
+	if (wheel->due_pos == wheel->due_count)
+		return false;
+	*item = wheel->due[wheel->due_pos++];
+	return true;
+}
+
+/* Invoked from the sweep workers; each one touches its own entry only. */
+static uint32_t *
+lookup_due(void * const data, const uint32_t item)
+{
+	struct watch_wheel * const wheel = data;
+	struct watch_entry * const entry = &wheel->entries[item];
+	char text[SPH_ADDRSTRLEN];
+	sph_ntop(entry->address, text);
+
+	return query_ttl(text, &entry->ttl);
+}
+
+static uint32_t *
+copy_verdict(const uint32_t * const verdict)
+{
+	const size_t size = (verdict[0] + 1) * sizeof(*verdict);
+	uint32_t * const copy = malloc(size);
+	if (copy == NULL)
+		err(1, "Could not allocate memory for a response");
+	memcpy(copy, verdict, size);
+	return copy;
+}
+
+static void
+check_done(void * const data, const uint32_t item,
+		const uint32_t * const verdict)
+{
+	struct watch_wheel * const wheel = data;
+	struct watch_entry * const entry = &wheel->entries[item];
+	char text[SPH_ADDRSTRLEN];
+	sph_ntop(entry->address, text);
+
+	if (verdict == NULL || (verdict[0] == 1 &&
+	    IS_SPAMHAUS_ERROR(verdict[1]))) {
+		/* Keep the last known verdict, try again a bit later. */
+		if (verdict != NULL) {
+			char * const resp = response_string(verdict[1]);
+			warnx("Spamhaus returned an error code for %s: %s",
+			    text, resp != NULL ? resp : "(unknown)");
+			free(resp);
+		}
+		schedule(wheel, item, wheel->now + wheel->min_interval);
+		return;
+	}
+
+	if (!same_verdict(entry->verdict, verdict))
+		report_transition(text, verdict);
+	free(entry->verdict);
+	entry->verdict = copy_verdict(verdict);
+
+	const uint32_t ttl = entry->ttl;
+	uint32_t interval = ttl < wheel->min_interval ? wheel->min_interval :
+	    ttl > wheel->max_interval ? wheel->max_interval : ttl;
+	/*
+	 * The addresses checked together at startup would otherwise keep
+	 * coming due in the same second; spread their first re-checks out.
+	 */
+	if (!entry->seen) {
+		entry->seen = true;
+		const uint32_t spread = interval / WATCH_JITTER_DIVISOR;
+		const uint32_t jitter = (uint32_t)(random() % (spread + 1));
+		if (interval + spread <= wheel->max_interval)
+			interval += jitter;
+		else if (interval - spread >= wheel->min_interval)
+			interval -= jitter;
+	}
+	debug("%s: next check in %u seconds\n", text, interval);
+	schedule(wheel, item, wheel->now + interval);
+}
+
+static void
+run_slot(struct watch_wheel * const wheel, const unsigned parallel)
+{
+	size_t * const slot = &wheel->slots[wheel->now % WHEEL_SIZE];
+	size_t idx = *slot;
+
+	*slot = WHEEL_NONE;
+	wheel->due_count = 0;
+	wheel->due_pos = 0;
+	while (idx != WHEEL_NONE) {
+		const size_t next = wheel->entries[idx].next;
+		if (wheel->entries[idx].due > wheel->now)
+			schedule(wheel, idx, wheel->entries[idx].due);
+		else
+			wheel->due[wheel->due_count++] = idx;
+		idx = next;
+	}
+	if (wheel->due_count == 0)
+		return;
+
+	debug("Re-checking %zu addresses\n", wheel->due_count);
+	const struct sweep_source source = {
+		.next = next_due,
+		.lookup = lookup_due,
+		.done = check_done,
+		.data = wheel,
+	};
+	struct sweep_result result = { 0 };
+	if (!sweep(&source, parallel, &result))
+		exit(1);
+	sweep_free(&result);
+}
+
+static void
+wait_for_tick(const struct timespec * const start, const uint64_t tick)
+{
+	const struct timespec deadline = {
+		.tv_sec = start->tv_sec + (time_t)tick,
+		.tv_nsec = start->tv_nsec,
+	};
+
+	/* If the checks took too long, catch up without sleeping. */
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+	    NULL) == EINTR)
+		;
+}
+
+void
+watch(const struct sph_range * const ranges, const size_t count,
+		const uint32_t min_interval, const uint32_t max_interval,
+		const unsigned parallel)
+{
+	size_t total = 0;
+	for (size_t idx = 0; idx < count; idx++) {
+		total += (size_t)(ranges[idx].last - ranges[idx].first) + 1;
+		if (total > WATCH_MAX_ADDRESSES)
+			errx(1, "Cannot watch more than %u addresses",
+			    WATCH_MAX_ADDRESSES);
+	}
+	debug("About to watch %zu addresses, re-checking at least every "
+	    "%u seconds\n", total, max_interval);
+
+	struct watch_wheel wheel = {
+		.entries = calloc(total, sizeof(*wheel.entries)),
+		.now = 0,
+		.min_interval = min_interval,
+		.max_interval = max_interval,
+		.due = malloc(total * sizeof(*wheel.due)),
+	};
+	if (wheel.entries == NULL || wheel.due == NULL)
+		err(1, "Could not allocate memory for %zu addresses", total);
+	for (size_t idx = 0; idx < WHEEL_SIZE; idx++)
+		wheel.slots[idx] = WHEEL_NONE;
+
+	/* Walk the list backwards so that the first address is checked first. */
+	size_t idx = total;
+	for (size_t range = count; range > 0; range--) {
+		uint32_t address = ranges[range - 1].last;
+		for (;;) {
+			idx--;
+			wheel.entries[idx].address = address;
+			schedule(&wheel, idx, 0);
+			if (address == ranges[range - 1].first)
+				break;
+			address--;
+		}
+	}
+
+	struct timespec start;
+	if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+		err(1, "Could not read the system clock");
+	srandom((unsigned)(start.tv_sec ^ start.tv_nsec));
+	for (;;) {
+		run_slot(&wheel, parallel);
+		/* The watch only ends when interrupted; keep the trace whole. */
+		if (dns_trace != NULL)
+			trace_flush(dns_trace);
+		wheel.now++;
+		wait_for_tick(&start, wheel.now);
+	}
+}
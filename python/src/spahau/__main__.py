@@ -25,19 +25,22 @@
 
 import argparse
 import dataclasses
+import ipaddress
 import json
 import sys
 
 from typing import Any, Callable, Dict, List, Tuple, Union  # noqa: H301
 
+import spahau
 from spahau import defs
 from spahau import query
 from spahau import response
+from spahau import sweep
 
 
 Result = Union[str, response.Response, List[response.Response]]
 
-ConfigHandler = Callable[[defs.Config, defs.IPAddress], Result]
+ConfigHandler = Callable[[defs.Config, int], Result]
 
 
 SELFTEST_DATA_DEFS: Dict[str, List[str]] = {
@@ -46,26 +49,27 @@ SELFTEST_DATA_DEFS: Dict[str, List[str]] = {
 }
 
 SELFTEST_DATA = {
-    defs.IPAddress.parse(name): [
+    defs.IPAddress.parse(name).value: [
         response.response_desc(defs.IPAddress.parse(item)) for item in value
     ]
     for name, value in SELFTEST_DATA_DEFS.items()
 }
 
 
-def cmd_describe(_cfg: defs.Config, address: defs.IPAddress) -> Result:
+def cmd_describe(_cfg: defs.Config, value: int) -> Result:
     """Describe the specified RBL return codes."""
-    return response.response_desc(address)
+    return response.response_for_value(value)
 
 
-def cmd_show_hostname(cfg: defs.Config, address: defs.IPAddress) -> Result:
+def cmd_show_hostname(cfg: defs.Config, value: int) -> Result:
     """Build and display the hostname for the query."""
-    return query.get_hostname(cfg, address)
+    return query.get_hostname(cfg, value)
 
 
-def cmd_selftest(cfg: defs.Config, address: defs.IPAddress) -> Result:
+def cmd_selftest(cfg: defs.Config, value: int) -> Result:
     """Run a self-test."""
-    expected = SELFTEST_DATA.get(address)
+    address = defs.value_to_text(value)
+    expected = SELFTEST_DATA.get(value)
     if expected is None:
         sys.exit(f"Unknown selftest address '{address}'")
 
@@ -75,7 +79,7 @@ def cmd_selftest(cfg: defs.Config, address: defs.IPAddress) -> Result:
             + " ".join(f"'{resp}'" for resp in expected)
         )
 
-    responses = query.query(cfg, address)
+    responses = query.query_value(cfg, value)
     if not cfg.json:
         print(
             f"...got {len(responses)} responses: "
@@ -88,9 +92,18 @@ def cmd_selftest(cfg: defs.Config, address: defs.IPAddress) -> Result:
     return responses
 
 
-def cmd_test(cfg: defs.Config, address: defs.IPAddress) -> Result:
+def cmd_test(cfg: defs.Config, value: int) -> Result:
     """Describe the specified RBL return codes."""
-    return query.query(cfg, address)
+    cfg.diag(f"Query for {defs.value_to_text(value)}")
+    return query.query_value(cfg, value)
+
+
+def parse_network(text: str) -> ipaddress.IPv4Network:
+    """Parse an address range, ignoring any host bits."""
+    try:
+        return ipaddress.IPv4Network(text, strict=False)
+    except ValueError as err:
+        sys.exit(f"Invalid address range '{text}': {err}")
 
 
 def parse_arguments() -> Tuple[defs.Config, ConfigHandler]:
@@ -109,6 +122,11 @@ def parse_arguments() -> Tuple[defs.Config, ConfigHandler]:
         default=defs.RBL_DOMAIN,
         help="specify the RBL domain to test against",
     )
+    parser.add_argument(
+        "--features",
+        action="store_true",
+        help="display the features supported by the program and exit",
+    )
     parser.add_argument(
         "--hostname",
         "-H",
@@ -118,6 +136,13 @@ def parse_arguments() -> Tuple[defs.Config, ConfigHandler]:
     parser.add_argument(
         "--json", "-j", action="store_true", help="display JSON output"
     )
+    parser.add_argument(
+        "--parallel",
+        "-p",
+        type=int,
+        default=defs.PARALLEL_DEFAULT,
+        help="the number of queries in flight when checking address ranges",
+    )
     parser.add_argument(
         "--selftest",
         "-T",
@@ -133,11 +158,21 @@ def parse_arguments() -> Tuple[defs.Config, ConfigHandler]:
     parser.add_argument(
         "addresses",
         type=str,
-        nargs="+",
-        help="the addresses to query or describe",
+        nargs="*",
+        help="the addresses or address ranges to query or describe",
     )
 
     args = parser.parse_args()
+    if args.features:
+        print(f"Features: spahau={spahau.VERSION} range=1.0")
+        sys.exit(0)
+    if not args.addresses:
+        parser.error("No addresses specified")
+    if args.parallel < 1 or args.parallel > defs.PARALLEL_MAX:
+        parser.error(
+            f"The number of parallel queries must be between 1 and "
+            f"{defs.PARALLEL_MAX}"
+        )
 
     key = (
         ("D" if args.describe else "")
@@ -153,11 +188,25 @@ def parse_arguments() -> Tuple[defs.Config, ConfigHandler]:
         "": cmd_test,
     }[key]
 
+    if any("/" in item for item in args.addresses):
+        if handler is not cmd_test:
+            sys.exit(
+                "Address ranges may only be checked, "
+                "not described, converted, or self-tested"
+            )
+        addresses = defs.AddressBatch()
+        networks = [parse_network(item) for item in args.addresses]
+    else:
+        addresses = defs.AddressBatch.parse(args.addresses)
+        networks = []
+
     return (
         defs.Config(
-            addresses=[defs.IPAddress.parse(item) for item in args.addresses],
+            addresses=addresses,
+            networks=networks,
             domain=str(args.domain),
             json=bool(args.json),
+            parallel=int(args.parallel),
             verbose=bool(args.verbose),
         ),
         handler,
@@ -167,20 +216,21 @@ def parse_arguments() -> Tuple[defs.Config, ConfigHandler]:
 def main() -> None:
     """Parse command-line arguments, do cri... err, things."""
     cfg, func = parse_arguments()
+    if cfg.networks:
+        sweep.report(cfg, sweep.sweep(cfg))
+        return
 
     data: Dict[str, Any] = {}
-    for address in cfg.addresses:
-        value = func(cfg, address)
+    for item, address in zip(cfg.addresses.values, cfg.addresses.texts()):
+        value = func(cfg, item)
         cfg.diag(f"{address}: got {value}")
         if cfg.json:
             if not value or isinstance(value, str):
-                data[address.text] = value
+                data[address] = value
             elif isinstance(value, response.Response):
-                data[address.text] = dataclasses.asdict(value)
+                data[address] = dataclasses.asdict(value)
             else:
-                data[address.text] = [
-                    dataclasses.asdict(item) for item in value
-                ]
+                data[address] = [dataclasses.asdict(item) for item in value]
             continue
 
         if isinstance(value, (str, response.Response)):
@@ -23,15 +23,29 @@
 # SUCH DAMAGE.
 """Type and constant definitions for the Spamhaus RBL client."""
 
+import array
 import dataclasses
+import functools
+import ipaddress
 import re
+import socket
+import struct
 import sys
 
-from typing import List, Tuple, Type  # noqa: H301
+from typing import Iterable, Iterator, List, Tuple, Type  # noqa: H301
 
 
 RBL_DOMAIN = "zen.spamhaus.org"
 
+PARALLEL_DEFAULT = 16
+PARALLEL_MAX = 256
+
+SPAMHAUS_ERROR_MASK = 0xFFFFFF00
+SPAMHAUS_ERROR_NET = 0x7FFFFF00
+
+# The "I" typecode is 32 bits wide on all the platforms we care about.
+ADDRESS_TYPECODE = "I"
+
 RE_IPV4 = re.compile(
     r""" ^
     (?:
@@ -84,18 +98,98 @@ class IPAddress:
             is_spamhaus_error=octets[:3] == [127, 255, 255],
         )
 
+    @classmethod
+    def from_value(cls: Type["IPAddress"], value: int) -> "IPAddress":
+        """Build an address out of its 32-bit integer value."""
+        octets = struct.unpack("4B", struct.pack("!I", value))
+        return cls(
+            text=value_to_text(value),
+            text_rev=value_to_text_rev(value),
+            octets=(octets[0], octets[1], octets[2], octets[3]),
+            value=value,
+            is_spamhaus_error=is_spamhaus_error(value),
+        )
+
     def __str__(self) -> str:
         """Provide a human-readable representation."""
         return self.text
 
 
+def value_to_text(value: int) -> str:
+    """Format a 32-bit address value as a dotted quad."""
+    return socket.inet_ntoa(struct.pack("!I", value))
+
+
+def value_to_text_rev(value: int) -> str:
+    """Format a 32-bit address value as a dotted quad, octets reversed."""
+    return socket.inet_ntoa(struct.pack("<I", value))
+
+
+def is_spamhaus_error(value: int) -> bool:
+    """Check whether a response value is within 127.255.255.0/24."""
+    return (value & SPAMHAUS_ERROR_MASK) == SPAMHAUS_ERROR_NET
+
+
+class AddressBatch:
+    """A compact batch of IPv4 addresses stored as 32-bit integers.
+
+    Only the packed values are kept; the sweep and the query layers work
+    on them directly, and the dotted-quad strings are built on demand.
+    """
+
+    __slots__ = ("values",)
+
+    def __init__(self, values: Iterable[int] = ()) -> None:
+        """Store the specified address values."""
+        self.values = array.array(ADDRESS_TYPECODE, values)
+
+    @classmethod
+    def parse(
+        cls: Type["AddressBatch"], texts: Iterable[str]
+    ) -> "AddressBatch":
+        """Parse a lot of dotted-quad strings at once."""
+        texts = list(texts)
+        try:
+            packed = b"".join(
+                map(functools.partial(socket.inet_pton, socket.AF_INET), texts)
+            )
+        except (OSError, TypeError):
+            for text in texts:
+                # Let the original parser pinpoint the problem.
+                IPAddress.parse(text)
+            raise
+
+        batch = cls()
+        batch.values.frombytes(packed)
+        if sys.byteorder == "little":
+            batch.values.byteswap()
+        return batch
+
+    @classmethod
+    def from_range(
+        cls: Type["AddressBatch"], first: int, last: int
+    ) -> "AddressBatch":
+        """Build a batch out of all the addresses from first to last."""
+        return cls(range(first, last + 1))
+
+    def __len__(self) -> int:
+        """Return the number of addresses in the batch."""
+        return len(self.values)
+
+    def texts(self) -> Iterator[str]:
+        """Produce the dotted-quad strings one at a time."""
+        return map(value_to_text, self.values)
+
+
 @dataclasses.dataclass(frozen=True)
 class Config:
     """Configuration for the main program."""
 
-    addresses: List[IPAddress]
+    addresses: AddressBatch
+    networks: List[ipaddress.IPv4Network]
     domain: str
     json: bool
+    parallel: int
     verbose: bool
 
     def diag(self, msg: str) -> None:
@@ -24,6 +24,7 @@
 """Query the Spamhaus RBL for the specified address."""
 
 import socket
+import struct
 
 from typing import List
 
@@ -31,18 +32,13 @@ from spahau import defs
 from spahau import response
 
 
-def get_hostname(cfg: defs.Config, address: defs.IPAddress) -> str:
-    """Build the hostname to query."""
-    cfg.diag(f"Building the hostname for {address} and {cfg.domain}")
-    return address.text_rev + "." + cfg.domain
+def get_hostname(cfg: defs.Config, value: int) -> str:
+    """Build the hostname to query for a 32-bit address value."""
+    return defs.value_to_text_rev(value) + "." + cfg.domain
 
 
-def query(
-    cfg: defs.Config, address: defs.IPAddress
-) -> List[response.Response]:
-    """Send a query, parse the responses."""
-    cfg.diag(f"Query for {address}")
-    hostname = get_hostname(cfg, address)
+def query_hostname(cfg: defs.Config, hostname: str) -> List[response.Response]:
+    """Send a query for an RBL hostname, parse the responses."""
     try:
         resp = socket.getaddrinfo(hostname, None, family=socket.AF_INET)
     except socket.gaierror as err:
@@ -51,13 +47,21 @@ def query(
 
         return []
 
-    cfg.diag(f"Response: {[(data[0], data[4]) for data in resp]}")
-    result = [defs.IPAddress.parse(data[4][0]) for data in resp]
-    errors = [addr for addr in result if addr.is_spamhaus_error]
+    if cfg.verbose:
+        cfg.diag(f"Response: {[(data[0], data[4]) for data in resp]}")
+    values = sorted(
+        {
+            struct.unpack("!I", socket.inet_aton(str(data[4][0])))[0]
+            for data in resp
+        }
+    )
+    errors = [value for value in values if defs.is_spamhaus_error(value)]
     if errors:
-        return [response.response_desc(errors[0])]
+        return [response.response_for_value(errors[0])]
 
-    return [
-        response.response_desc(resp)
-        for resp in sorted(set(result), key=lambda addr: addr.octets)
-    ]
+    return [response.response_for_value(value) for value in values]
+
+
+def query_value(cfg: defs.Config, value: int) -> List[response.Response]:
+    """Send a query for a 32-bit address value, parse the responses."""
+    return query_hostname(cfg, get_hostname(cfg, value))
@@ -25,7 +25,7 @@
 
 import dataclasses
 
-from typing import Optional
+from typing import Dict, Optional
 
 from spahau import defs
 
@@ -99,3 +99,16 @@ def response_desc(address: defs.IPAddress) -> Response:
     return Response(
         tag="UNKNOWN", reason="unexpected Spamhaus response", address=address
     )
+
+
+KNOWN_VALUES: Dict[int, Response] = {}
+
+
+def response_for_value(value: int) -> Response:
+    """Describe a response value, only caching the known Spamhaus ones."""
+    resp = KNOWN_VALUES.get(value)
+    if resp is None:
+        resp = response_desc(defs.IPAddress.from_value(value))
+        if resp.tag != "UNKNOWN":
+            KNOWN_VALUES[value] = resp
+    return resp
@@ -0,0 +1,162 @@
+# Copyright (c) 2020  Peter Pentchev <roam@ringlet.net>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+"""Check whole address ranges with a bounded number of queries in flight."""
+
+import array
+import concurrent.futures
+import dataclasses
+import ipaddress
+import itertools
+import json
+import socket
+import sys
+
+from typing import Dict, Iterator, List, Set, Tuple  # noqa: H301
+
+from spahau import defs
+from spahau import query
+from spahau import response
+
+
+# Do not build more than that many addresses at once for a single range.
+BATCH_SIZE = 65536
+
+# A return code and the addresses that it was returned for.
+Group = Tuple[response.Response, "array.array[int]"]
+
+
+@dataclasses.dataclass
+class SweepResult:
+    """The listed addresses found during a sweep, grouped by return code.
+
+    The addresses are kept as 32-bit values, the groups are keyed by
+    the value of the return code.
+    """
+
+    checked: int = 0
+    failed: int = 0
+    listed: Set[int] = dataclasses.field(default_factory=set)
+    groups: Dict[int, Group] = dataclasses.field(default_factory=dict)
+
+    def record(self, value: int, responses: List[response.Response]) -> None:
+        """Store the responses obtained for a single address."""
+        self.checked += 1
+        for resp in responses:
+            assert resp.address is not None
+            if resp.tag == "ERROR":
+                # No real answer was obtained.
+                self.failed += 1
+            else:
+                self.listed.add(value)
+            group = self.groups.get(resp.address.value)
+            if group is None:
+                group = (resp, array.array(defs.ADDRESS_TYPECODE))
+                self.groups[resp.address.value] = group
+            group[1].append(value)
+
+
+def expand(
+    networks: List[ipaddress.IPv4Network],
+) -> Iterator[defs.AddressBatch]:
+    """Lazily produce batches of the addresses within the specified ranges."""
+    for net in networks:
+        last = int(net.broadcast_address)
+        for first in range(int(net.network_address), last + 1, BATCH_SIZE):
+            yield defs.AddressBatch.from_range(
+                first, min(first + BATCH_SIZE - 1, last)
+            )
+
+
+def sweep(cfg: defs.Config) -> SweepResult:
+    """Query for all the addresses, cfg.parallel of them at a time."""
+    cfg.diag(f"Sweeping with {cfg.parallel} queries in flight")
+    result = SweepResult()
+    addresses = itertools.chain.from_iterable(
+        batch.values for batch in expand(cfg.networks)
+    )
+    with concurrent.futures.ThreadPoolExecutor(cfg.parallel) as pool:
+        pending = {
+            pool.submit(query.query_value, cfg, value): value
+            for value in itertools.islice(addresses, cfg.parallel)
+        }
+        while pending:
+            done, _ = concurrent.futures.wait(
+                pending, return_when=concurrent.futures.FIRST_COMPLETED
+            )
+            for fut in done:
+                value = pending.pop(fut)
+                try:
+                    result.record(value, fut.result())
+                except socket.gaierror as err:
+                    print(
+                        f"Could not query {defs.value_to_text(value)}: "
+                        f"{err}",
+                        file=sys.stderr,
+                    )
+                    result.checked += 1
+                    result.failed += 1
+
+            for value in itertools.islice(addresses, len(done)):
+                pending[pool.submit(query.query_value, cfg, value)] = value
+
+    cfg.diag(
+        f"Checked {result.checked} addresses, {len(result.listed)} listed, "
+        f"{result.failed} failed"
+    )
+    return result
+
+
+def report(cfg: defs.Config, result: SweepResult) -> None:
+    """Display the listed addresses grouped by return code."""
+    groups = [
+        (resp, [defs.value_to_text(value) for value in sorted(addresses)])
+        for _, (resp, addresses) in sorted(result.groups.items())
+    ]
+    if cfg.json:
+        print(
+            json.dumps(
+                {
+                    "checked": result.checked,
+                    "listed": len(result.listed),
+                    "failed": result.failed,
+                    "responses": {
+                        str(resp.address): {
+                            "tag": resp.tag,
+                            "reason": resp.reason,
+                            "addresses": addresses,
+                        }
+                        for resp, addresses in groups
+                    },
+                },
+                indent=2,
+            )
+        )
+        return
+
+    print(
+        f"Checked {result.checked} addresses: {len(result.listed)} listed, "
+        f"{result.failed} failed"
+    )
+    for resp, addresses in groups:
+        print(f"{resp}: " + " ".join(addresses))
@@ -4,11 +4,15 @@ use v5.12;
 use strict;
 use warnings;
 
+use FindBin;
+use lib "$FindBin::Bin/lib";
 use Time::HiRes qw(usleep);
 
 use Test::More;
 use Test::Command;
 
+use SpahauTrace qw(dns_exchange test_server);
+
 my $prog = $ENV{TEST_PROG};
 if (!defined $prog) {
 	BAIL_OUT "No TEST_PROG in the environment";
@@ -16,14 +20,26 @@ if (!defined $prog) {
 
 plan tests => 41;
 
+my @server = test_server($prog,
+    dns_exchange('1.0.0.127.zen.spamhaus.org', 60),
+    dns_exchange('2.0.0.127.zen.spamhaus.org',
+	60, '127.0.0.2', '127.0.0.4', '127.0.0.10'),
+    dns_exchange('2.0.0.127.nosuchsbl.ringlet.net', 60));
+
+# Only go easy on the real Spamhaus servers.
+sub pause()
+{
+	usleep(500000) unless @server;
+}
+
 my @cmdstr = ($prog);
 my $cmd = Test::Command->new(cmd => \@cmdstr);
 $cmd->exit_isnt_num(0, "'@cmdstr' failed with no addresses specified");
 $cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
 $cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
-usleep(500000);
+pause();
 
-@cmdstr = ($prog, '127.0.0.1');
+@cmdstr = ($prog, @server, '127.0.0.1');
 $cmd = Test::Command->new(cmd => \@cmdstr);
 $cmd->exit_is_num(0, "'@cmdstr' completed successfully");
 $cmd->stdout_isnt_eq('', "'@cmdstr' produced some output");
@@ -37,9 +53,9 @@ $cmd->stdout_unlike(
     qr{The IP address: 127\.0\.0\.2 is},
     "'@cmdstr' did not report anything about 127.0.0.2");
 $cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
-usleep(500000);
+pause();
 
-@cmdstr = ($prog, '127.0.0.2');
+@cmdstr = ($prog, @server, '127.0.0.2');
 $cmd = Test::Command->new(cmd => \@cmdstr);
 $cmd->exit_is_num(0, "'@cmdstr' completed successfully");
 $cmd->stdout_isnt_eq('', "'@cmdstr' produced some output");
@@ -59,9 +75,9 @@ $cmd->stdout_unlike(
     qr{The IP address: 127\.0\.0\.1 is},
     "'@cmdstr' did not report anything about 127.0.0.1");
 $cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
-usleep(500000);
+pause();
 
-@cmdstr = ($prog, '127.0.0.1', '127.0.0.2');
+@cmdstr = ($prog, @server, '127.0.0.1', '127.0.0.2');
 $cmd = Test::Command->new(cmd => \@cmdstr);
 $cmd->exit_is_num(0, "'@cmdstr' completed successfully");
 $cmd->stdout_isnt_eq('', "'@cmdstr' produced some output");
@@ -84,9 +100,9 @@ $cmd->stdout_like(
     qr{The IP address: 127\.0\.0\.2 is found.*'127\.0\.0\.10 - PBL - ISP Maintained'},
     "'@cmdstr' found 127.0.0.2 in the ISP-maintained list");
 $cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
-usleep(500000);
+pause();
 
-@cmdstr = ($prog, '-v', '127.0.0.1', '127.0.0.2');
+@cmdstr = ($prog, @server, '-v', '127.0.0.1', '127.0.0.2');
 $cmd = Test::Command->new(cmd => \@cmdstr);
 $cmd->exit_is_num(0, "'@cmdstr' completed successfully");
 $cmd->stdout_isnt_eq('', "'@cmdstr' produced some output");
@@ -109,9 +125,9 @@ $cmd->stdout_like(
     qr{The IP address: 127\.0\.0\.2 is found.*'127\.0\.0\.10 - PBL - ISP Maintained'},
     "'@cmdstr' found 127.0.0.2 in the ISP-maintained list");
 $cmd->stderr_isnt_eq('', "'@cmdstr' produced some diagnostic output");
-usleep(500000);
+pause();
 
-@cmdstr = ($prog, '-d', 'nosuchsbl.ringlet.net', '127.0.0.2');
+@cmdstr = ($prog, @server, '-d', 'nosuchsbl.ringlet.net', '127.0.0.2');
 $cmd = Test::Command->new(cmd => \@cmdstr);
 $cmd->exit_is_num(0, "'@cmdstr' completed successfully");
 $cmd->stdout_isnt_eq('', "'@cmdstr' produced some output");
@@ -125,4 +141,4 @@ $cmd->stdout_unlike(
     qr{The IP address: 127\.0\.0\.1 is},
     "'@cmdstr' did not report anything about 127.0.0.1");
 $cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
-usleep(500000);
+pause();
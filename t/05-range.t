@@ -0,0 +1,91 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use FindBin;
+use lib "$FindBin::Bin/lib";
+use Time::HiRes qw(usleep);
+
+use Test::More;
+use Test::Command;
+
+use SpahauTrace qw(dns_exchange test_server);
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\brange=/m) {
+	plan skip_all => "$prog does not support checking address ranges";
+}
+
+plan tests => 18;
+
+my @server = test_server($prog,
+    dns_exchange('0.0.0.127.zen.spamhaus.org', 60),
+    dns_exchange('1.0.0.127.zen.spamhaus.org', 60),
+    dns_exchange('2.0.0.127.zen.spamhaus.org',
+	60, '127.0.0.2', '127.0.0.4', '127.0.0.10'),
+    dns_exchange('3.0.0.127.zen.spamhaus.org', 60),
+    dns_exchange('0.0.0.127.nosuchsbl.ringlet.net', 60),
+    dns_exchange('1.0.0.127.nosuchsbl.ringlet.net', 60),
+    dns_exchange('2.0.0.127.nosuchsbl.ringlet.net', 60),
+    dns_exchange('3.0.0.127.nosuchsbl.ringlet.net', 60));
+
+# Only go easy on the real Spamhaus servers.
+sub pause()
+{
+	usleep(500000) unless @server;
+}
+
+my @cmdstr = ($prog, @server, '127.0.0.2/32');
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(
+    qr{^Checked 1 addresses: 1 listed, 0 failed$}m,
+    "'@cmdstr' checked and found a single address");
+$cmd->stdout_like(
+    qr{^127\.0\.0\.2 - SBL - Spamhaus SBL Data: 127\.0\.0\.2$}m,
+    "'@cmdstr' found 127.0.0.2 in the Spamhaus SBL data list");
+$cmd->stdout_like(
+    qr{^127\.0\.0\.10 - PBL - ISP Maintained: 127\.0\.0\.2$}m,
+    "'@cmdstr' found 127.0.0.2 in the ISP-maintained list");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+pause();
+
+@cmdstr = ($prog, @server, '-p', '4', '127.0.0.1', '127.0.0.2/31');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(
+    qr{^Checked 3 addresses: 1 listed, 0 failed$}m,
+    "'@cmdstr' checked three addresses, found one");
+$cmd->stdout_unlike(
+    qr{127\.0\.0\.[13]\b},
+    "'@cmdstr' did not report the unlisted addresses");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+pause();
+
+@cmdstr = ($prog, @server, '-d', 'nosuchsbl.ringlet.net', '127.0.0.0/30');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq(
+    "Checked 4 addresses: 0 listed, 0 failed\n",
+    "'@cmdstr' did not find anything");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+pause();
+
+@cmdstr = ($prog, '127.0.0.0/33');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with an invalid prefix length");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-H', '127.0.0.0/30');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' refused to build hostnames for a range");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
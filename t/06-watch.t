@@ -0,0 +1,98 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use File::Temp qw(tempdir);
+use FindBin;
+use IO::Select;
+use Time::HiRes qw(time);
+use Test::More;
+use Test::Command;
+
+use lib "$FindBin::Bin/lib";
+use SpahauTrace qw(dns_exchange write_trace start_replay stop_replay);
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\bwatch=/m) {
+	plan skip_all => "$prog does not support the watch mode";
+}
+
+plan tests => 16;
+
+my @cmdstr = ($prog, '--watch');
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with no addresses specified");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '--watch', '-H', '127.0.0.2');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' refused to watch hostnames");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '--watch', '-i', '5', '127.0.0.2');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' refused a too short interval");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+my @watch = ($prog, '-p', '4', '--watch', '127.0.0.0/30', '192.0.2.5');
+my $pid = open my $watch, '-|', @watch or die "Could not run '@watch': $!\n";
+my @reports = sort map { scalar(<$watch>) // '' } 1..2;
+kill 'TERM', $pid;
+close $watch;
+like $reports[0], qr{^127\.0\.0\.2: now listed: '127\.0\.0\.2 - SBL},
+    "'@watch' reported 127.0.0.2 as listed";
+like $reports[1], qr{^192\.0\.2\.5: now listed:},
+    "'@watch' reported 192.0.2.5 as listed";
+
+if ($features !~ /\btrace=/) {
+	SKIP: {
+		skip "$prog cannot replay DNS traces", 5;
+	}
+	exit 0;
+}
+
+# Listed, listed for the same reason, for another one, then not at all.
+my $tempd = tempdir(CLEANUP => 1);
+my $trace = "$tempd/watch.trace";
+my $name = '7.2.0.192.zen.spamhaus.org';
+write_trace($trace,
+    dns_exchange($name, 2, '127.0.0.2'),
+    dns_exchange($name, 2, '127.0.0.2'),
+    dns_exchange($name, 2, '127.0.0.4'),
+    dns_exchange($name, 0));
+my $server = start_replay($prog, $trace);
+
+@watch = ($prog, '-s', $server, '-m', '1', '--watch', '192.0.2.7');
+$pid = open $watch, '-|', @watch or die "Could not run '@watch': $!\n";
+my $select = IO::Select->new($watch);
+my (@lines, @times);
+while (@lines < 4 && $select->can_read(@lines < 3 ? 10 : 3)) {
+	my $line = <$watch>;
+	last unless defined $line;
+	push @lines, $line;
+	push @times, time;
+}
+kill 'TERM', $pid;
+close $watch;
+stop_replay($server);
+
+like $lines[0] // '', qr{^192\.0\.2\.7: now listed: '127\.0\.0\.2 - SBL},
+    "'@watch' reported the address as listed";
+like $lines[1] // '', qr{^192\.0\.2\.7: now listed: '127\.0\.0\.4 - XBL},
+    "'@watch' reported the new reason, not the unchanged one";
+is $lines[2] // '', "192.0.2.7: no longer listed\n",
+    "'@watch' reported the address as no longer listed";
+is scalar @lines, 3, "'@watch' did not report the unchanged answers";
+# The checks are two seconds apart, as the TTL says, not -m's one second.
+cmp_ok +($times[2] // 0) - ($times[0] // 0), '>=', 5,
+    "'@watch' re-checked the address when the TTL expired";
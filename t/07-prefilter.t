@@ -0,0 +1,101 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use File::Temp qw(tempdir);
+
+use Test::More;
+use Test::Command;
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\bprefilter=/m) {
+	plan skip_all => "$prog does not support prefilters";
+}
+
+plan tests => 24;
+
+my $tempd = tempdir(CLEANUP => 1);
+my $zone = "$tempd/zone";
+my $badzone = "$tempd/badzone";
+my $filter = "$tempd/filter";
+
+open my $fh, '>', $zone or die "Could not create $zone: $!\n";
+print $fh <<'EOZONE';
+# A tiny rbldnsd-style zone
+:127.0.0.2:Listed
+127.0.0.2
+192.0.2.8/30
+198.51.100.10-20
+203.0.113.250-203.0.114.3
+!192.0.2.9
+EOZONE
+close $fh or die "Could not write to $zone: $!\n";
+
+open $fh, '>', $badzone or die "Could not create $badzone: $!\n";
+print $fh "127.0.0.2\nthis.is.not.an.address\n";
+close $fh or die "Could not write to $badzone: $!\n";
+
+my @cmdstr = ($prog, '-B', $zone);
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with no prefilter file specified");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-B', '-f', $filter, $badzone);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with an invalid zone entry");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-B', '-f', $filter, $zone);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ($prog, '-f', $filter, '127.0.0.2');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(
+    qr{The IP address: 127\.0\.0\.2 is found.*'127\.0\.0\.2 - SBL - Spamhaus SBL Data'},
+    "'@cmdstr' still queried for 127.0.0.2");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ($prog, '-v', '-f', $filter, '127.0.0.1');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(
+    qr{The IP address: 127\.0\.0\.1 is NOT found in the Spamhaus blacklists},
+    "'@cmdstr' did not find 127.0.0.1");
+$cmd->stderr_like(
+    qr{127\.0\.0\.1 is not in the prefilter},
+    "'@cmdstr' did not need to query for 127.0.0.1");
+
+@cmdstr = ($prog, '-f', $zone, '127.0.0.2');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' refused to use a zone file as a prefilter");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-v', '-f', $filter, '203.0.114.2');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(qr{The IP address: 203\.0\.114\.2 is NOT found},
+    "'@cmdstr' did not find 203.0.114.2");
+$cmd->stderr_unlike(qr{not in the prefilter},
+    "'@cmdstr' found 203.0.114.2 within a full address range");
+
+@cmdstr = ($prog, '-v', '-f', $filter, '203.0.114.4');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(qr{The IP address: 203\.0\.114\.4 is NOT found},
+    "'@cmdstr' did not find 203.0.114.4");
+$cmd->stderr_like(qr{203\.0\.114\.4 is not in the prefilter},
+    "'@cmdstr' did not need to query for 203.0.114.4");
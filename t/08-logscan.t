@@ -0,0 +1,89 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use File::Temp qw(tempdir);
+
+use Test::More;
+use Test::Command;
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\blogscan=/m) {
+	plan skip_all => "$prog does not support scanning log files";
+}
+
+plan tests => 17;
+
+my $tempd = tempdir(CLEANUP => 1);
+my $log = "$tempd/mail.log";
+my $empty = "$tempd/empty.log";
+
+open my $fh, '>', $log or die "Could not create $log: $!\n";
+print $fh <<'EOLOG';
+Apr 15 10:00:01 mx postfix/smtpd[1234]: connect from unknown[127.0.0.2]
+Apr 15 10:00:01 mx postfix/smtpd[1234]: 4A0B1C2D3E: client=unknown[127.0.0.2]
+Apr 15 10:00:02 mx postfix/smtpd[1235]: connect from localhost[127.0.0.1]
+Apr 15 10:00:03 mx postfix/smtpd[1236]: connect from unknown[2001:db8::1]
+Apr 15 10:00:04 mx postfix/smtpd[1237]: connect from unknown[127.0.0.2]
+Apr 15 10:00:04 mx postfix/smtpd[1234]: NOQUEUE: reject: RCPT from unknown[127.0.0.2]: 554 5.7.1
+Apr 15 10:00:04 mx postfix/smtpd[1234]: disconnect from unknown[127.0.0.2] ehlo=1 quit=1
+Apr 15 10:00:04 mx postfix/smtp[1238]: 5B0C: to=<b@example.net>, relay=mx.example.net[192.0.2.5]:25, status=sent
+2020-04-15 10:00:05 1jOk2a-0001 <= a@example.com H=(helo) [127.0.0.1]:2525
+2020-04-15 10:00:05 1jOk2b-0001 <= b@example.com H=mx.example.org ([192.0.2.9]) [127.0.0.2]:25
+2020-04-15 10:00:06 1jOk2b-0001 => c@example.net R=dnslookup T=remote_smtp H=mx.example.net [192.0.2.5]
+Not addresses: [300.0.0.1] [127.0.0] [127.0.0.1.1] [127.0.0.2
+EOLOG
+close $fh or die "Could not write to $log: $!\n";
+
+open $fh, '>', $empty or die "Could not create $empty: $!\n";
+close $fh or die "Could not write to $empty: $!\n";
+
+my @cmdstr = ($prog, '-L');
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with no log files specified");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-L', "$tempd/nonexistent.log");
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with a nonexistent log file");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-L', $empty);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq(
+    "Found 0 client connections from 0 addresses: 0 listed, 0 failed\n",
+    "'@cmdstr' did not find anything");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ($prog, '-L', $log, $empty);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(
+    qr{^Found 5 client connections from 2 addresses: 1 listed, 0 failed$}m,
+    "'@cmdstr' found the client addresses");
+$cmd->stdout_like(
+    qr{^3 127\.0\.0\.2: '127\.0\.0\.2 - SBL - Spamhaus SBL Data'}m,
+    "'@cmdstr' counted and found 127.0.0.2 in the Spamhaus SBL data list");
+$cmd->stdout_like(
+    qr{^3 127\.0\.0\.2:.*'127\.0\.0\.10 - PBL - ISP Maintained'$}m,
+    "'@cmdstr' found 127.0.0.2 in the ISP-maintained list");
+$cmd->stdout_unlike(
+    qr{127\.0\.0\.1\b},
+    "'@cmdstr' did not report anything about 127.0.0.1");
+$cmd->stdout_unlike(
+    qr{192\.0\.2\.[59]\b},
+    "'@cmdstr' did not check the relays or the HELO names");
+$cmd->stdout_unlike(
+    qr{300\.0\.0\.1},
+    "'@cmdstr' did not report anything about an invalid address");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
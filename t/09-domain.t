@@ -0,0 +1,97 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use File::Temp qw(tempdir);
+
+use Test::More;
+use Test::Command;
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\bdomain=/m) {
+	plan skip_all => "$prog does not support checking domain names";
+}
+
+plan tests => 21;
+
+my $tempd = tempdir(CLEANUP => 1);
+my $list = "$tempd/domains.txt";
+
+open my $fh, '>', $list or die "Could not create $list: $!\n";
+print $fh <<'EOLIST';
+dbltest.com
+http://www.DBLtest.com/some/path?query#fragment
+postmaster@dbltest.com
+
+example.org
+not-a-domain
+EOLIST
+close $fh or die "Could not write to $list: $!\n";
+
+my @cmdstr = ($prog, '-n');
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with no domain names specified");
+$cmd->stdout_is_eq('', "'@cmdstr' did not produce any output");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-n', '-H', 'HTTP://user@WWW.Example.CO.UK:8080/path',
+    'mail.b.example.com.', "b\x{c3}\x{bc}cher.de");
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq(
+    "example.co.uk.dbl.spamhaus.org\n" .
+    "example.com.dbl.spamhaus.org\n" .
+    "xn--bcher-kva.de.dbl.spamhaus.org\n",
+    "'@cmdstr' normalised the domain names");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ($prog, '-n', '-H', "B\x{c3}\x{9c}CHER.de",
+    "\x{d0}\x{9f}\x{d0}\x{a0}\x{d0}\x{98}\x{d0}\x{9c}" .
+    "\x{d0}\x{95}\x{d0}\x{a0}.\x{d0}\x{a0}\x{d0}\x{a4}");
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq(
+    "xn--bcher-kva.de.dbl.spamhaus.org\n" .
+    "xn--e1afmkfd.xn--p1ai.dbl.spamhaus.org\n",
+    "'@cmdstr' lowercased the non-ASCII letters");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ($prog, '-n', '-H', '-d', 'zrd.example.net', 'Example.COM',
+    'www.example.com', '192.0.2.1');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq("example.com.zrd.example.net\n",
+    "'@cmdstr' only output a single RBL hostname");
+$cmd->stderr_like(qr{192\.0\.2\.1.*not a domain name},
+    "'@cmdstr' complained about the IP address");
+
+@cmdstr = ($prog, '-n', 'example.org');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq(
+    "Found 1 domain names, 1 unique: 0 listed, 0 failed\n",
+    "'@cmdstr' did not find anything");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ('sh', '-c', "$prog -n - < '$list'");
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(
+    qr{^Found 4 domain names, 2 unique: 1 listed, 0 failed$}m,
+    "'@cmdstr' found the domain names");
+$cmd->stdout_like(
+    qr{^3 dbltest\.com: '127\.0\.1\.2 - DBL - spam domain'$}m,
+    "'@cmdstr' counted and found dbltest.com in the DBL");
+$cmd->stdout_unlike(qr{example\.org},
+    "'@cmdstr' did not report anything about example.org");
+$cmd->stderr_like(qr{not-a-domain},
+    "'@cmdstr' complained about the invalid name");
+$cmd->stderr_unlike(qr{dbltest|example},
+    "'@cmdstr' did not complain about the valid names");
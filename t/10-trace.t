@@ -0,0 +1,80 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use File::Temp qw(tempdir);
+
+use Test::More;
+use Test::Command;
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\btrace=/m) {
+	plan skip_all => "$prog does not support recording DNS traces";
+}
+
+plan tests => 16;
+
+my $tempd = tempdir(CLEANUP => 1);
+my $trace = "$tempd/queries.trace";
+my $server = '127.0.0.1:' . (20000 + $$ % 20000);
+
+my @cmdstr = ($prog, '-w', $trace, '127.0.0.2', '127.0.0.1');
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(qr{^The IP address: 127\.0\.0\.2 is found}m,
+    "'@cmdstr' found 127.0.0.2");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+my $recorded = $cmd->stdout_value;
+
+open my $fh, '<:raw', $trace or die "Could not open $trace: $!\n";
+my $magic;
+read $fh, $magic, 8;
+close $fh;
+is $magic, "SPHDNS1\n", "'@cmdstr' wrote a trace file";
+
+@cmdstr = ($prog, '-R');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with no trace file specified");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+@cmdstr = ($prog, '-R', "$tempd/nonexistent.trace");
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed with a nonexistent trace file");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+my @replay = ($prog, '-s', $server, '-R', $trace);
+my $pid = open my $replay, '-|', @replay or
+    die "Could not run '@replay': $!\n";
+my $ready = <$replay> // '';
+like $ready,
+    qr{^Replaying 2 answers for 2 questions on \Q$server\E$},
+    "'@replay' loaded the trace";
+
+@cmdstr = ($prog, '-s', $server, '127.0.0.2', '127.0.0.1');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq($recorded, "'@cmdstr' got the recorded answers");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+@cmdstr = ($prog, '-s', $server, '192.0.2.5');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->stdout_is_eq('', "'@cmdstr' did not get an answer");
+$cmd->stderr_like(qr{Could not obtain a result for '192\.0\.2\.5'},
+    "'@cmdstr' reported the missing answer");
+
+@cmdstr = ($prog, '-s', $server, '-n', 'dbltest.com');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->stdout_like(qr{^Found 1 domain names, 1 unique: 0 listed, 1 failed$}m,
+    "'@cmdstr' did not get an answer for a name not in the trace");
+$cmd->stderr_like(qr{dbltest\.com\.dbl\.spamhaus\.org},
+    "'@cmdstr' reported the missing answer");
+
+kill 'TERM', $pid;
+close $replay;
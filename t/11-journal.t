@@ -0,0 +1,117 @@
+#!/usr/bin/perl
+
+use v5.12;
+use strict;
+use warnings;
+
+use File::Temp qw(tempdir);
+
+use Test::More;
+use Test::Command;
+
+my $prog = $ENV{TEST_PROG};
+if (!defined $prog) {
+	BAIL_OUT "No TEST_PROG in the environment";
+}
+
+my $features = `$prog --features 2>/dev/null` // '';
+if ($features !~ /^Features:.*\bjournal=/m) {
+	plan skip_all => "$prog does not support journals";
+}
+
+plan tests => 22;
+
+my $tempd = tempdir(CLEANUP => 1);
+my $journal = "$tempd/ranges.journal";
+my @ranges = ('192.0.2.0/28', '127.0.0.0/30');
+
+my @cmdstr = ($prog, @ranges);
+my $cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+my $expected = $cmd->stdout_value;
+
+@cmdstr = ($prog, '-J', $journal, @ranges);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq($expected, "'@cmdstr' output the same summary");
+$cmd->stderr_is_eq('', "'@cmdstr' did not output any warnings or errrors");
+
+open my $fh, '<:raw', $journal or die "Could not open $journal: $!\n";
+my $magic;
+read $fh, $magic, 8;
+close $fh;
+is $magic, "SPHJRN1\n", "'@cmdstr' wrote a journal file";
+
+# No DNS server listens there, so all the answers must come from the journal.
+@cmdstr = ($prog, '-s', '127.0.0.1:1', '-J', $journal, @ranges);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq($expected, "'@cmdstr' replayed the journal");
+$cmd->stderr_is_eq('', "'@cmdstr' did not send any queries");
+
+truncate $journal, (-s $journal) - 3 or
+    die "Could not truncate $journal: $!\n";
+@cmdstr = ($prog, '-J', $journal, @ranges);
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_is_eq($expected, "'@cmdstr' checked the missing address again");
+$cmd->stderr_like(qr{Discarding a partial record},
+    "'@cmdstr' reported the partial record");
+
+@cmdstr = ($prog, '-J', $journal, '192.0.2.0/29');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' refused a journal for other ranges");
+$cmd->stdout_is_eq('', "'@cmdstr' did not output anything");
+$cmd->stderr_like(qr{different address ranges},
+    "'@cmdstr' reported the mismatch");
+
+@cmdstr = ($prog, '-J', $journal, '127.0.0.2');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_isnt_num(0, "'@cmdstr' failed without any address ranges");
+$cmd->stderr_isnt_eq('', "'@cmdstr' output some error messages");
+
+# A trace that first answers with a Spamhaus error, then with a listing.
+sub dns_name($) {
+	return join('', map { chr(length) . $_ } split /\./, $_[0]) . "\0";
+}
+
+sub dns_exchange($ @) {
+	my ($name, @octets) = @_;
+	my $question = dns_name($name) . pack('nn', 1, 1);
+	my $query = pack('n6', 0, 0x0100, 1, 0, 0, 0) . $question;
+	my $answer = pack('n6', 0, 0x8180, 1, 1, 0, 0) . $question .
+	    pack('nnnNn', 0xC00C, 1, 1, 60, 4) . pack('C4', @octets);
+	return pack('NNNNnn', 0, 0, 0, 60, length $query, length $answer) .
+	    $query . $answer;
+}
+
+my $trace = "$tempd/errors.trace";
+open my $tfh, '>:raw', $trace or die "Could not create $trace: $!\n";
+print $tfh "SPHDNS1\n", pack('NN', 1, 0),
+    dns_exchange('5.2.0.192.zen.spamhaus.org', 127, 255, 255, 254),
+    dns_exchange('5.2.0.192.zen.spamhaus.org', 127, 0, 0, 11);
+close $tfh or die "Could not write $trace: $!\n";
+
+my $server = '127.0.0.1:' . (20000 + ($$ + 1) % 20000);
+my @replay = ($prog, '-F', '-s', $server, '-R', $trace);
+my $pid = open my $replay, '-|', @replay or
+    die "Could not run '@replay': $!\n";
+my $ready = <$replay> // '';
+like $ready, qr{^Replaying 2 answers for 1 questions},
+    "'@replay' loaded the trace";
+
+$journal = "$tempd/errors.journal";
+@cmdstr = ($prog, '-s', $server, '-J', $journal, '192.0.2.5/32');
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(qr{^Checked 1 addresses: 0 listed, 1 failed$}m,
+    "'@cmdstr' got the Spamhaus error");
+is -s $journal, 32, "'@cmdstr' did not journal the Spamhaus error";
+
+$cmd = Test::Command->new(cmd => \@cmdstr);
+$cmd->exit_is_num(0, "'@cmdstr' completed successfully");
+$cmd->stdout_like(qr{^Checked 1 addresses: 1 listed, 0 failed$}m,
+    "'@cmdstr' queried for the address again");
+
+kill 'TERM', $pid;
+close $replay;
@@ -0,0 +1,93 @@
+package SpahauTrace;
+
+use v5.12;
+use strict;
+use warnings;
+
+use Exporter qw(import);
+use File::Temp qw(tempfile);
+
+our @EXPORT_OK = qw(dns_exchange write_trace start_replay stop_replay
+    test_server);
+
+my %replays;
+
+sub dns_name($)
+{
+	my ($name) = @_;
+
+	return join('', map { chr(length) . $_ } split /\./, $name) . "\0";
+}
+
+# A recorded query and answer; no addresses means "no such name".
+sub dns_exchange($ $ @)
+{
+	my ($name, $ttl, @addresses) = @_;
+
+	my $question = dns_name($name) . pack('nn', 1, 1);
+	my $query = pack('n6', 0, 0x0100, 1, 0, 0, 0) . $question;
+	my $answer = pack('n6', 0, @addresses ? 0x8180 : 0x8183, 1,
+	    scalar @addresses, 0, 0) . $question;
+	for my $address (@addresses) {
+		$answer .= pack('nnnNn', 0xC00C, 1, 1, $ttl, 4) .
+		    pack('C4', split /\./, $address);
+	}
+	return pack('NNNNnn', 0, 0, 0, $ttl, length $query, length $answer) .
+	    $query . $answer;
+}
+
+sub write_trace($ @)
+{
+	my ($path, @exchanges) = @_;
+
+	open my $fh, '>:raw', $path or die "Could not create $path: $!\n";
+	print $fh "SPHDNS1\n", pack('NN', 1, 0), @exchanges;
+	close $fh or die "Could not write $path: $!\n";
+}
+
+# Answer the queries right away; return the address to send them to.
+sub start_replay($ $)
+{
+	my ($prog, $trace) = @_;
+
+	state $count = 0;
+	my $server = '127.0.0.1:' . (20000 + ($$ + $count++) % 20000);
+	my @cmd = ($prog, '-F', '-s', $server, '-R', $trace);
+	my $pid = open my $fh, '-|', @cmd or die "Could not run '@cmd': $!\n";
+	my $ready = <$fh> // '';
+	die "'@cmd' did not start: $ready\n" unless
+	    $ready =~ /^Replaying \d+ answers for \d+ questions/;
+	$replays{$server} = [$pid, $fh];
+	return $server;
+}
+
+sub stop_replay($)
+{
+	my ($server) = @_;
+
+	my ($pid, $fh) = @{delete $replays{$server}};
+	kill 'TERM', $pid;
+	close $fh;
+}
+
+# The -s arguments that point the program at $ENV{TEST_SERVER} or at
+# a replay of the exchanges; none if it can only query the real Spamhaus.
+sub test_server($ @)
+{
+	my ($prog, @exchanges) = @_;
+
+	my $features = `$prog --features 2>/dev/null` // '';
+	return () unless $features =~ /^Features:.*\btrace=/m;
+	return ('-s', $ENV{TEST_SERVER}) if $ENV{TEST_SERVER};
+
+	my (undef, $trace) = tempfile(UNLINK => 1);
+	write_trace($trace, @exchanges);
+	return ('-s', start_replay($prog, $trace));
+}
+
+END {
+	local $?;
+	stop_replay($_) for keys %replays;
+}
+
+1;